@@ -0,0 +1,12 @@
+#ifndef BOTTOMUP_H
+#define BOTTOMUP_H
+
+#include "quadtree.h"
+
+/* Builds the tree from the pixels upwards in one linear pass: each level
+ * aggregates the sums and sums of squares of the level below, and a group
+ * of four leaves collapses into its parent while the combined error stays
+ * under ctx->threshold (mean error per pixel, in units of ctx->metric). */
+QuadtreeNode* build_quadtree_bottom_up(QuadtreeContext *ctx, const PixelBuffer *image);
+
+#endif // BOTTOMUP_H
@@ -3,6 +3,7 @@
 
 /* Image Configuration */
 #define DEFAULT_IMAGE_SIZE 512
+#define MAX_IMAGE_SIZE 32768  /* Largest side: block pixel counts must fit an int */
 
 /* Heap Configuration */
 #define DEFAULT_HEAP_CAPACITY 1024
@@ -12,6 +13,40 @@
 #define MIN_NODE_SIZE 1
 #define MERGE_THRESHOLD 25.0
 #define GRAPH_NODE_CAPACITY_INITIAL 10000
+#define BOTTOM_UP_ERROR_THRESHOLD 64.0
+
+/* Error Metric Configuration */
+#define DEFAULT_ERROR_METRIC METRIC_RGBA_SQUARED
+#define METRIC_WEIGHT_R 2
+#define METRIC_WEIGHT_G 4
+#define METRIC_WEIGHT_B 3
+#define METRIC_WEIGHT_A 1
+#define YCBCR_LUMA_WEIGHT 4.0
+
+/* YCbCr Mode Configuration (thresholds are mean squared error per pixel) */
+#define LUMA_ERROR_THRESHOLD 16.0
+#define CHROMA_ERROR_THRESHOLD 48.0
+#define CHROMA_SUBSAMPLING 2  /* Power of two */
+#define YCBCR_MAX_SIZE 16384  /* Largest luma size accepted from a .qty header */
+
+/* Parallel Passes Configuration */
+#define PARALLEL_THREADS 4
+#define PARALLEL_SPLIT_DEPTH 3
+
+/* Batch Pipeline Configuration */
+#define PIPELINE_DECODE_WORKERS 2
+#define PIPELINE_BUILD_WORKERS 4
+#define PIPELINE_SAVE_WORKERS 1
+#define PIPELINE_QUEUE_CAPACITY 8
+
+/* Encode Daemon Configuration */
+#define DAEMON_WORKERS 4
+#define DAEMON_BACKLOG 64
+#define DAEMON_REQUEST_LENGTH 1024
+#define DAEMON_IO_BUFFER 65536
+#define DAEMON_MAX_INPUT (256 * 1024 * 1024)  /* Largest input a request may submit */
+#define DAEMON_ACCEPT_BACKOFF_US 100000
+#define DAEMON_READ_TIMEOUT_S 5                /* A client silent this long is dropped */
 
 /* UI Configuration */
 #define WINDOW_WIDTH 860
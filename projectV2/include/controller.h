@@ -5,6 +5,6 @@
 #include "view.h"
 #include "heap.h"
 
-void run_application(MLV_Image *image);
+void run_application(QuadtreeContext *ctx, const PixelBuffer *image);
 
 #endif // CONTROLLER_H
@@ -0,0 +1,25 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "quadtree.h"
+
+/* Long-lived encode/decode service on a Unix domain socket.
+ *
+ * One request per connection, as a single line:
+ *   ENCODE <image_file> <output.qtc|output.qtn|output.qty>
+ *   DECODE <file.qtc|file.qtn|file.qty> <output.ppm> [size]
+ * answered by "OK encoded", "OK cached" or "ERR <reason>". Paths must be
+ * absolute and cannot contain spaces. The socket is only accessible to its
+ * owner.
+ *
+ * Results are kept in cache_dir under a hash of the input file content and
+ * of every parameter that changes the output, so resubmitted assets are
+ * answered with a file copy. Every worker encodes with ctx. */
+int run_encode_daemon(QuadtreeContext *ctx, const char *socket_path, const char *cache_dir, int workers);
+int submit_daemon_request(const char *socket_path, const char *request);
+
+/* Resolves path against the current directory and symlinks into resolved.
+ * The last component may not exist yet. Returns 0 if it can't be resolved */
+int absolute_path(const char *path, char *resolved, size_t size);
+
+#endif // DAEMON_H
@@ -9,9 +9,11 @@ typedef struct {
     int capacity;
 } MaxHeap;
 
-MaxHeap* create_max_heap(int capacity);
-void max_heapify(MaxHeap* heap, int idx);
-void insert_max_heap(MaxHeap* heap, QuadtreeNode* node);
-QuadtreeNode* extract_max(MaxHeap* heap);
+/* Storage comes from ctx->allocator; create returns NULL and insert 0 when
+ * it runs out */
+MaxHeap* create_max_heap(QuadtreeContext *ctx, int capacity);
+void free_max_heap(QuadtreeContext *ctx, MaxHeap* heap);
+int insert_max_heap(QuadtreeContext *ctx, MaxHeap* heap, QuadtreeNode* node);
+QuadtreeNode* extract_max_heap(MaxHeap* heap);
 
 #endif // HEAP_H
@@ -0,0 +1,12 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "quadtree.h"
+
+/* Loads an image through MLV, resized to DEFAULT_IMAGE_SIZE, into a buffer
+ * the quadtree library can read, allocated with ctx->allocator (release it
+ * with free_pixel_buffer). Returns NULL if the file can't be read. Safe to
+ * call from several threads: only the file decoding is serialized. */
+PixelBuffer* load_source_image(QuadtreeContext *ctx, const char* filename);
+
+#endif // IMAGE_H
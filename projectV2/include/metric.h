@@ -0,0 +1,25 @@
+#ifndef METRIC_H
+#define METRIC_H
+
+#include "utils.h"
+
+/* Error metrics available for the split criterion.
+ * The metric is chosen once per encode (QuadtreeContext.metric); each one has its own specialized
+ * block kernel so no indirect call happens in the per-pixel loop. */
+typedef enum {
+    METRIC_RGBA_SQUARED,  /* Squared RGBA distance (historical default) */
+    METRIC_WEIGHTED,      /* Per-channel weighted squared distance */
+    METRIC_LUMA,          /* Squared luma difference only */
+    METRIC_MAX_ABS,       /* Largest absolute channel difference */
+    METRIC_YCBCR,         /* Perceptual YCbCr, luma weighted over chroma */
+    METRIC_COUNT
+} ErrorMetric;
+
+const char* error_metric_name(ErrorMetric metric);
+int parse_error_metric(const char *name, ErrorMetric *metric);
+
+/* image must be in PIXEL_LAYOUT_MORTON, the block is read as one run */
+double metric_block_error(ErrorMetric metric, const PixelBuffer *image, int x, int y, int size, Color avg_color);
+double metric_color_distance(ErrorMetric metric, Color c1, Color c2);
+
+#endif // METRIC_H
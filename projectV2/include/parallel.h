@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+#include "quadtree.h"
+
+/* Parallel versions of the whole-tree passes. The tree is cut at
+ * PARALLEL_SPLIT_DEPTH: the subtrees below the cut are processed by
+ * ctx->threads workers, the few nodes above it by the calling thread.
+ * With ctx->threads == 1 nothing is spawned: callers that already spread
+ * images over their own threads pass such a context so threads don't
+ * multiply. */
+
+typedef enum {
+    SAVE_FORMAT_QTC,
+    SAVE_FORMAT_QTN,
+    SAVE_FORMAT_GRAPH
+} SaveFormat;
+
+/* 0 if the image is invalid or can't be converted; other allocation
+ * failures only make the passes fall back to their serial versions */
+int minimize_with_loss_parallel(QuadtreeContext *ctx, QuadtreeNode *root, const PixelBuffer *image);
+void save_quadtree_parallel(QuadtreeContext *ctx, FILE *file, QuadtreeNode *root, SaveFormat format);
+void assign_ids_parallel(QuadtreeContext *ctx, QuadtreeNode *root);
+
+#endif // PARALLEL_H
@@ -0,0 +1,42 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include "quadtree.h"
+
+/* Fixed-size FIFO shared between two pipeline stages. Producers block when
+ * it is full, consumers block when it is empty, and the queue is drained
+ * once every producer has called close_bounded_queue. Aborting wakes
+ * everyone up and makes further pushes fail. */
+typedef struct {
+    void **items;
+    int capacity;
+    int head;
+    int count;
+    int open_producers;
+    int aborted;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} BoundedQueue;
+
+typedef struct {
+    int decode_workers;
+    int build_workers;
+    int save_workers;
+    int queue_capacity;
+} PipelineConfig;
+
+BoundedQueue* create_bounded_queue(int capacity, int producers);
+void free_bounded_queue(BoundedQueue *queue);
+int push_bounded_queue(BoundedQueue *queue, void *item);
+void* pop_bounded_queue(BoundedQueue *queue);
+void close_bounded_queue(BoundedQueue *queue);
+void abort_bounded_queue(BoundedQueue *queue);
+void* drain_bounded_queue(BoundedQueue *queue);
+
+PipelineConfig default_pipeline_config(void);
+int run_encode_pipeline(QuadtreeContext *ctx, const char *input_dir, const char *output_dir,
+                        const PipelineConfig *config, int *failures);
+
+#endif // PIPELINE_H
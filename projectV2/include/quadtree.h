@@ -1,50 +1,120 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
-#include <MLV/MLV_all.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "config.h"
+#include "utils.h"
+#include "metric.h"
 
 typedef struct QuadtreeNode {
     int x, y, size;
-    MLV_Color color;
+    Color color;
     double error;
     struct QuadtreeNode *children[4];
     int id;
 } QuadtreeNode;
 
+/* Source of every allocation the library makes: tree nodes, pixel buffers
+ * and work arrays. alloc returns NULL on failure, which the library reports
+ * through its return values; user is handed back to both callbacks. With
+ * ctx->threads > 1 the parallel passes call both from their own threads,
+ * so the allocator must then be thread-safe even if the caller never
+ * shares the context. Stdio is the one exception: FILE streams, including
+ * the memory streams the parallel savers write each subtree into, are
+ * allocated by libc. */
+typedef struct {
+    void* (*alloc)(void *user, size_t size);
+    void (*release)(void *user, void *ptr);
+    void *user;
+} QuadtreeAllocator;
+
+typedef struct {
+    long nodes_created;
+    long nodes_freed;
+    long subdivisions;
+    long merges;
+} QuadtreeStats;
+
+/* Everything an encode or decode depends on. The library keeps no global
+ * state, so independent contexts can be used from any number of threads. */
+typedef struct {
+    QuadtreeAllocator allocator;
+    ErrorMetric metric;
+    double threshold;         /* Bottom-up build, mean error per pixel */
+    double merge_threshold;   /* Lossy minimization */
+    double luma_threshold;    /* YCbCr mode, mean squared error per pixel */
+    double chroma_threshold;
+    int threads;              /* Workers of the parallel passes, 1 to stay on the caller's thread */
+    QuadtreeStats stats;
+    void (*on_subdivide)(QuadtreeNode *node, void *user);  /* Optional progress hook */
+    void *callback_user;
+} QuadtreeContext;
+
 #include "heap.h"
 
-MLV_Color average_color(MLV_Image *image, int x, int y, int size);
-double color_distance(MLV_Color c1, MLV_Color c2);
-double calculate_error(MLV_Image *image, int x, int y, int size, MLV_Color avg_color);
+void init_quadtree_context(QuadtreeContext *ctx);
+
+/* ctx->allocator wrappers. quadtree_grow keeps the first old_size bytes and
+ * leaves ptr untouched when it fails */
+void* quadtree_alloc(QuadtreeContext *ctx, size_t size);
+void* quadtree_grow(QuadtreeContext *ctx, void *ptr, size_t old_size, size_t new_size);
+void quadtree_release(QuadtreeContext *ctx, void *ptr);
 
-QuadtreeNode* create_quadtree_node(int x, int y, int size, MLV_Color color, double error);
-QuadtreeNode* build_quadtree(MLV_Image *image, int x, int y, int size, MaxHeap* heap);
+PixelBuffer* create_pixel_buffer(QuadtreeContext *ctx, int width, int height);
+void free_pixel_buffer(QuadtreeContext *ctx, PixelBuffer *image);
+PixelBuffer* morton_pixel_buffer(QuadtreeContext *ctx, const PixelBuffer *image);
+const PixelBuffer* ingest_pixel_buffer(QuadtreeContext *ctx, const PixelBuffer *image, PixelBuffer **owned);
+/* Entry points only take square images with a power-of-two side */
+int validate_pixel_buffer(const PixelBuffer *image);
 
-void free_quadtree(QuadtreeNode *node);
-void minimize_with_loss(QuadtreeNode* root, MLV_Image *image);
-double quadtree_distance(QuadtreeNode* t1, QuadtreeNode* t2);
+/* Block kernels: image must be in PIXEL_LAYOUT_MORTON. encode_quadtree,
+ * minimize_with_loss and the other entry points accept either layout. */
+Color average_color(const PixelBuffer *image, int x, int y, int size);
+double color_distance(QuadtreeContext *ctx, Color c1, Color c2);
+double calculate_error(QuadtreeContext *ctx, const PixelBuffer *image, int x, int y, int size, Color avg_color);
 
-QuadtreeNode* draw_quadtree_no_loss(MLV_Image *image);
-void draw_quadtree_with_loss(QuadtreeNode* quadtree, MLV_Image *image);
-void subdivide_and_draw(MLV_Image *image, MaxHeap* heap);
+QuadtreeNode* create_quadtree_node(QuadtreeContext *ctx, int x, int y, int size, Color color, double error);
+QuadtreeNode* build_quadtree(QuadtreeContext *ctx, const PixelBuffer *image, int x, int y, int size, MaxHeap* heap);
+
+void free_quadtree(QuadtreeContext *ctx, QuadtreeNode *node);
+int minimize_with_loss(QuadtreeContext *ctx, QuadtreeNode* root, const PixelBuffer *image);
+void minimize_node(QuadtreeContext *ctx, QuadtreeNode* root, const PixelBuffer *image);
+double quadtree_distance(QuadtreeContext *ctx, QuadtreeNode* t1, QuadtreeNode* t2);
+
+/* NULL when the image is invalid or an allocation fails */
+QuadtreeNode* encode_quadtree(QuadtreeContext *ctx, const PixelBuffer *image);
+int subdivide_quadtree(QuadtreeContext *ctx, const PixelBuffer *image, MaxHeap* heap);
 
 void save_quadtree_binary(FILE *file, QuadtreeNode *node);
-void save_image_quadtree(const char *filename, QuadtreeNode *quadtree);
+/* Savers return 0, and leave no file behind, when the write fails */
+int save_image_quadtree(QuadtreeContext *ctx, const char *filename, QuadtreeNode *quadtree);
 
-const char* get_file_extension(const char *filename);
+const char* quadtree_file_extension(const char *filename);
 
 void save_quadtree_binary_bw(FILE *file, QuadtreeNode *node);
-void save_image_quadtree_bw(const char *filename, QuadtreeNode *quadtree);
+int save_image_quadtree_bw(QuadtreeContext *ctx, const char *filename, QuadtreeNode *quadtree);
 void save_quadtree_as_graph(FILE *file, QuadtreeNode *node);
-void save_image_quadtree_graph(const char *filename, QuadtreeNode *quadtree);
+int save_image_quadtree_graph(QuadtreeContext *ctx, const char *filename, QuadtreeNode *quadtree);
+int quadtree_finish_save(FILE *file, const char *filename);
+
+QuadtreeNode* load_quadtree_binary(QuadtreeContext *ctx, FILE *file, int size, int x, int y);
+QuadtreeNode* load_quadtree_binary_bw(QuadtreeContext *ctx, FILE *file, int size, int x, int y);
+QuadtreeNode* load_image_quadtree(QuadtreeContext *ctx, const char *filename);
+QuadtreeNode* load_image_quadtree_bw(QuadtreeContext *ctx, const char *filename);
+QuadtreeNode* load_quadtree_graph(QuadtreeContext *ctx, FILE *file);
 
-QuadtreeNode* load_quadtree_binary(FILE *file, int size, int x, int y);
-QuadtreeNode* load_quadtree_binary_bw(FILE *file, int size, int x, int y);
-QuadtreeNode* load_image_quadtree(const char *filename);
-QuadtreeNode* load_image_quadtree_bw(const char *filename);
-QuadtreeNode* load_quadtree_graph(FILE *file);
+void derive_internal_colors(QuadtreeNode *node);
+int read_quadtree_leaf_color(FILE *file, int bw, Color *color);
+int skip_quadtree_stream(FILE *file, int bw, int size, double weight, double sums[4]);
+QuadtreeNode* load_quadtree_binary_lod(QuadtreeContext *ctx, FILE *file, int size, int x, int y, int max_depth);
+QuadtreeNode* load_quadtree_binary_bw_lod(QuadtreeContext *ctx, FILE *file, int size, int x, int y, int max_depth);
+QuadtreeNode* load_image_quadtree_lod(QuadtreeContext *ctx, const char *filename, int max_depth);
+QuadtreeNode* load_image_quadtree_bw_lod(QuadtreeContext *ctx, const char *filename, int max_depth);
+int lod_depth_for_resolution(int output_size);
 
 void assign_ids(QuadtreeNode *node, int *current_id);
+int count_quadtree_nodes(QuadtreeNode *node);
 
 #endif // QUADTREE_H
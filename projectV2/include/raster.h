@@ -0,0 +1,12 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "quadtree.h"
+
+/* Decodes a .qtc/.qtn stream in a single forward pass straight into a binary
+ * PPM of output_size x output_size pixels (a power of two). No tree is built:
+ * memory is bounded by the recursion depth and the mapped output file.
+ * .qty files are recombined from their three trees at native size only. */
+int decode_quadtree_to_ppm(QuadtreeContext *ctx, const char *input, const char *output, int output_size);
+
+#endif // RASTER_H
@@ -0,0 +1,11 @@
+#ifndef SAFE_ALLOC_H
+#define SAFE_ALLOC_H
+
+#include <stddef.h>
+
+/* Application-side allocation: print and exit when memory runs out. The
+ * library never exits and allocates through ctx->allocator instead. */
+void* safe_malloc(size_t size);
+void* safe_realloc(void* ptr, size_t size);
+
+#endif // SAFE_ALLOC_H
@@ -1,21 +1,98 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include <MLV/MLV_all.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+/* Packed 0xRRGGBBAA color, same layout as MLV_Color */
+typedef uint32_t Color;
+
+#define COLOR_BLACK ((Color)0x000000ff)
+
+static inline Color rgba_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    return ((Color)r << 24) | ((Color)g << 16) | ((Color)b << 8) | (Color)a;
+}
+
+static inline void color_to_rgba(Color color, uint8_t *r, uint8_t *g, uint8_t *b, uint8_t *a) {
+    *r = (uint8_t)(color >> 24);
+    *g = (uint8_t)(color >> 16);
+    *b = (uint8_t)(color >> 8);
+    *a = (uint8_t)color;
+}
+
+/* Interleaves the bits of x (even) and y (odd). In this Z-order, every
+ * aligned power-of-two block is one contiguous run whose four quadrants
+ * follow each other in quadtree child order. */
+static inline uint32_t spread_bits(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static inline uint32_t compact_bits(uint32_t v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return v;
+}
+
+static inline size_t morton_index(int x, int y) {
+    return spread_bits((uint32_t)x) | (spread_bits((uint32_t)y) << 1);
+}
+
+static inline int morton_x(size_t index) {
+    return (int)compact_bits((uint32_t)index);
+}
+
+static inline int morton_y(size_t index) {
+    return (int)compact_bits((uint32_t)(index >> 1));
+}
+
+typedef enum {
+    PIXEL_LAYOUT_ROW_MAJOR,
+    PIXEL_LAYOUT_MORTON      /* Square power-of-two image in Z-order */
+} PixelLayout;
+
+/* RGBA pixels, 4 bytes per pixel */
+typedef struct {
+    uint8_t *pixels;
+    int width;
+    int height;
+    PixelLayout layout;
+} PixelBuffer;
+
+static inline const uint8_t* pixel_at(const PixelBuffer *image, int x, int y) {
+    if (image->layout == PIXEL_LAYOUT_MORTON) {
+        return image->pixels + morton_index(x, y) * 4;
+    }
+    return image->pixels + ((size_t)y * image->width + x) * 4;
+}
+
 /* Color component extraction functions */
-Uint8 get_red_component(MLV_Color color);
-Uint8 get_green_component(MLV_Color color);
-Uint8 get_blue_component(MLV_Color color);
-Uint8 get_alpha_component(MLV_Color color);
+static inline uint8_t get_red_component(Color color) {
+    return (uint8_t)(color >> 24);
+}
+
+static inline uint8_t get_green_component(Color color) {
+    return (uint8_t)(color >> 16);
+}
+
+static inline uint8_t get_blue_component(Color color) {
+    return (uint8_t)(color >> 8);
+}
 
-/* Safe memory allocation functions */
-void* safe_malloc(size_t size);
-void* safe_realloc(void* ptr, size_t size);
+static inline uint8_t get_alpha_component(Color color) {
+    return (uint8_t)color;
+}
 
 /* File validation functions */
-bool file_exists(const char* filename);
+bool quadtree_file_exists(const char* filename);
 bool validate_quadtree_file(const char* filename);
 
 #endif // UTILS_H
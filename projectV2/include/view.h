@@ -2,9 +2,15 @@
 #define VIEW_H
 
 #include "quadtree.h"
+#include "ycbcr.h"
 
 void draw_quadtree(QuadtreeNode *node);
 void draw_entire_quadtree(QuadtreeNode *node);
+void draw_quadtree_scaled(QuadtreeNode *node, int ox, int oy, int output_size);
+void draw_quadtree_thumbnail(QuadtreeNode *node, int ox, int oy, int output_size);
+void draw_ycbcr_quadtree(QuadtreeContext *ctx, YCbCrQuadtree *quadtree);
+QuadtreeNode* draw_quadtree_no_loss(QuadtreeContext *ctx, const PixelBuffer *image);
+void draw_quadtree_with_loss(QuadtreeContext *ctx, QuadtreeNode *quadtree, const PixelBuffer *image);
 void draw_buttons();
 int handle_button_click(int x, int y);
 
@@ -0,0 +1,29 @@
+#ifndef YCBCR_H
+#define YCBCR_H
+
+#include "quadtree.h"
+
+/* An image split into a full-resolution luma tree and two subsampled chroma
+ * trees, each built with its own error threshold (ctx->luma_threshold and
+ * ctx->chroma_threshold). Plane values are stored as gray node colors so
+ * the trees reuse the QTN leaf encoding. */
+typedef struct {
+    QuadtreeNode *luma;
+    QuadtreeNode *cb;
+    QuadtreeNode *cr;
+    int luma_size;
+    int chroma_size;
+} YCbCrQuadtree;
+
+/* plane is a square of bytes in Morton order */
+QuadtreeNode* build_plane_quadtree(QuadtreeContext *ctx, const uint8_t *plane, int x, int y, int size, double threshold);
+/* NULL when the image is invalid or an allocation fails */
+YCbCrQuadtree* build_ycbcr_quadtree(QuadtreeContext *ctx, const PixelBuffer *image);
+void free_ycbcr_quadtree(QuadtreeContext *ctx, YCbCrQuadtree *quadtree);
+
+int save_image_quadtree_ycbcr(const char *filename, YCbCrQuadtree *quadtree);
+YCbCrQuadtree* load_image_quadtree_ycbcr(QuadtreeContext *ctx, const char *filename);
+
+int rasterize_ycbcr_quadtree(QuadtreeContext *ctx, YCbCrQuadtree *quadtree, uint8_t *rgb);
+
+#endif // YCBCR_H
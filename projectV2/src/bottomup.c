@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bottomup.h"
+#include "../include/quadtree.h"
+#include "../include/metric.h"
+#include "../include/config.h"
+#include "../include/utils.h"
+
+/* Aggregated statistics of a square block. The error is measured on up to
+ * four feature channels (RGBA, luma or YCbCr depending on the metric) so
+ * that it can be derived from sums alone: SSE = sumsq - sum^2 / n. */
+typedef struct {
+    uint64_t rgba[4];
+    double sum[4];
+    double sumsq[4];
+    int min[4];
+    int max[4];
+    QuadtreeNode *node;  /* NULL while the block is still a single leaf */
+} BlockStats;
+
+static void pixel_features(ErrorMetric metric, int r, int g, int b, int a, double feature[4]) {
+    switch (metric) {
+        case METRIC_LUMA:
+            feature[0] = 0.299 * r + 0.587 * g + 0.114 * b;
+            feature[1] = feature[2] = feature[3] = 0.0;
+            break;
+        case METRIC_YCBCR:
+            feature[0] = 0.299 * r + 0.587 * g + 0.114 * b;
+            feature[1] = -0.168736 * r - 0.331264 * g + 0.5 * b;
+            feature[2] = 0.5 * r - 0.418688 * g - 0.081312 * b;
+            feature[3] = a;
+            break;
+        default:
+            feature[0] = r;
+            feature[1] = g;
+            feature[2] = b;
+            feature[3] = a;
+            break;
+    }
+}
+
+static void feature_weights(ErrorMetric metric, double weight[4]) {
+    switch (metric) {
+        case METRIC_WEIGHTED:
+            weight[0] = METRIC_WEIGHT_R;
+            weight[1] = METRIC_WEIGHT_G;
+            weight[2] = METRIC_WEIGHT_B;
+            weight[3] = METRIC_WEIGHT_A;
+            break;
+        case METRIC_LUMA:
+            weight[0] = 1.0;
+            weight[1] = weight[2] = weight[3] = 0.0;
+            break;
+        case METRIC_YCBCR:
+            weight[0] = YCBCR_LUMA_WEIGHT;
+            weight[1] = weight[2] = weight[3] = 1.0;
+            break;
+        default:
+            weight[0] = weight[1] = weight[2] = weight[3] = 1.0;
+            break;
+    }
+}
+
+static void pixel_stats(ErrorMetric metric, const uint8_t *rgba, BlockStats *stats) {
+    double feature[4];
+    pixel_features(metric, rgba[0], rgba[1], rgba[2], rgba[3], feature);
+
+    for (int c = 0; c < 4; c++) {
+        stats->rgba[c] = rgba[c];
+        stats->sum[c] = feature[c];
+        stats->sumsq[c] = feature[c] * feature[c];
+        stats->min[c] = rgba[c];
+        stats->max[c] = rgba[c];
+    }
+    stats->node = NULL;
+}
+
+static double block_error(ErrorMetric metric, const double weight[4], const BlockStats *stats, int count) {
+    if (metric == METRIC_MAX_ABS) {
+        /* Not decomposable into sums: the channel range bounds every pixel's
+         * distance to the mean, so the block is only merged when the exact
+         * error would be under the threshold too */
+        int range = 0;
+        for (int c = 0; c < 4; c++) {
+            if (stats->max[c] - stats->min[c] > range) range = stats->max[c] - stats->min[c];
+        }
+        return (double)range * count;
+    }
+
+    double error = 0.0;
+    for (int c = 0; c < 4; c++) {
+        double sse = stats->sumsq[c] - stats->sum[c] * stats->sum[c] / count;
+        if (sse > 0.0) error += weight[c] * sse;
+    }
+    return error;
+}
+
+/* Truncated like average_color, so both builders give a block the same color */
+static Color block_color(const BlockStats *stats, int count) {
+    return rgba_color((uint8_t)(stats->rgba[0] / count), (uint8_t)(stats->rgba[1] / count),
+                      (uint8_t)(stats->rgba[2] / count), (uint8_t)(stats->rgba[3] / count));
+}
+
+/* Combines four children (in quadtree order) into parent; children that
+ * were still single leaves get their node only when the parent cannot
+ * absorb them. Returns 0 when a node can't be allocated, leaving every
+ * node built so far in children */
+static int merge_block(QuadtreeContext *ctx, const double weight[4],
+                        BlockStats children[4], int x, int y, int size, BlockStats *parent) {
+    ErrorMetric metric = ctx->metric;
+    int half_size = size / 2;
+    int child_count = half_size * half_size;
+    int count = size * size;
+    int all_leaves = 1;
+
+    for (int c = 0; c < 4; c++) {
+        parent->rgba[c] = children[0].rgba[c] + children[1].rgba[c] + children[2].rgba[c] + children[3].rgba[c];
+        parent->sum[c] = children[0].sum[c] + children[1].sum[c] + children[2].sum[c] + children[3].sum[c];
+        parent->sumsq[c] = children[0].sumsq[c] + children[1].sumsq[c] + children[2].sumsq[c] + children[3].sumsq[c];
+        parent->min[c] = children[0].min[c];
+        parent->max[c] = children[0].max[c];
+        for (int k = 1; k < 4; k++) {
+            if (children[k].min[c] < parent->min[c]) parent->min[c] = children[k].min[c];
+            if (children[k].max[c] > parent->max[c]) parent->max[c] = children[k].max[c];
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        if (children[k].node) all_leaves = 0;
+    }
+
+    double error = block_error(metric, weight, parent, count);
+    parent->node = NULL;
+    if (all_leaves && error <= ctx->threshold * count) {
+        return 1;
+    }
+
+    static const int offset_x[4] = {0, 1, 0, 1};
+    static const int offset_y[4] = {0, 0, 1, 1};
+    QuadtreeNode *node = create_quadtree_node(ctx, x, y, size, block_color(parent, count), error);
+    if (!node) return 0;
+    for (int k = 0; k < 4; k++) {
+        if (!children[k].node) {
+            children[k].node = create_quadtree_node(ctx, x + offset_x[k] * half_size, y + offset_y[k] * half_size,
+                                                    half_size, block_color(&children[k], child_count),
+                                                    block_error(metric, weight, &children[k], child_count));
+            if (!children[k].node) {
+                free_quadtree(ctx, node);
+                return 0;
+            }
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        node->children[k] = children[k].node;
+    }
+    parent->node = node;
+    return 1;
+}
+
+/* After a failed merge of group k, the nodes built so far hang from the
+ * parents merged before it, from the group itself and from the groups of
+ * the level below not reached yet (entries 4k + 4 to pending) */
+static void free_level_nodes(QuadtreeContext *ctx, BlockStats *level, size_t k, BlockStats children[4], size_t pending) {
+    for (size_t i = 0; i < k; i++) {
+        free_quadtree(ctx, level[i].node);
+    }
+    for (int c = 0; c < 4; c++) {
+        free_quadtree(ctx, children[c].node);
+    }
+    for (size_t i = 4 * k + 4; i < pending; i++) {
+        free_quadtree(ctx, level[i].node);
+    }
+}
+
+QuadtreeNode* build_quadtree_bottom_up(QuadtreeContext *ctx, const PixelBuffer *image) {
+    ErrorMetric metric = ctx->metric;
+    double weight[4];
+    feature_weights(metric, weight);
+
+    if (!validate_pixel_buffer(image)) return NULL;
+    if (image->width < 2) {
+        fprintf(stderr, "Error: Image too small for the bottom-up builder\n");
+        return NULL;
+    }
+    PixelBuffer *owned;
+    image = ingest_pixel_buffer(ctx, image, &owned);
+    if (!image) return NULL;
+
+    /* Levels are kept in Morton order like the pixels: the four children of
+     * block k are entries 4k..4k+3 of the level below */
+    int size = image->width;
+    size_t blocks = (size_t)size * size / 4;
+    BlockStats *level = (BlockStats*)quadtree_alloc(ctx, blocks * sizeof(BlockStats));
+    if (!level) {
+        free_pixel_buffer(ctx, owned);
+        return NULL;
+    }
+    BlockStats children[4];
+    QuadtreeNode *root = NULL;
+    int ok = 1;
+
+    /* First level straight from the pixels, in memory order */
+    const uint8_t *pixel = image->pixels;
+    for (size_t k = 0; ok && k < blocks; k++) {
+        for (int c = 0; c < 4; c++, pixel += 4) {
+            pixel_stats(metric, pixel, &children[c]);
+        }
+        if (!merge_block(ctx, weight, children, 2 * morton_x(k), 2 * morton_y(k), 2, &level[k])) {
+            free_level_nodes(ctx, level, k, children, 0);
+            ok = 0;
+        }
+    }
+
+    /* Each further level folds in place: parent k only reads entries from
+     * 4k on, which are never overwritten before use */
+    int block_size = 2;
+    while (ok && blocks > 1) {
+        size_t pending = blocks;
+        blocks /= 4;
+        block_size *= 2;
+        for (size_t k = 0; ok && k < blocks; k++) {
+            memcpy(children, &level[4 * k], sizeof(children));
+            if (!merge_block(ctx, weight, children, block_size * morton_x(k), block_size * morton_y(k),
+                             block_size, &level[k])) {
+                free_level_nodes(ctx, level, k, children, pending);
+                ok = 0;
+            }
+        }
+    }
+
+    if (ok) {
+        root = level[0].node;
+        if (!root) {
+            root = create_quadtree_node(ctx, 0, 0, size, block_color(&level[0], size * size),
+                                        block_error(metric, weight, &level[0], size * size));
+        }
+    }
+    quadtree_release(ctx, level);
+    free_pixel_buffer(ctx, owned);
+    return root;
+}
@@ -9,7 +9,7 @@
 
 #define MAX_FILENAME_LENGTH 256
 
-void run_application(MLV_Image *image) {
+void run_application(QuadtreeContext *ctx, const PixelBuffer *image) {
     QuadtreeNode* quadtree = NULL;
 
     while (1) {
@@ -21,40 +21,40 @@ void run_application(MLV_Image *image) {
 
         switch (button) {
             case 1:
-                if (quadtree) free_quadtree(quadtree);
-                quadtree = draw_quadtree_no_loss(image);
+                if (quadtree) free_quadtree(ctx, quadtree);
+                quadtree = draw_quadtree_no_loss(ctx, image);
                 break;
             case 2:
                 if (quadtree) {
                     char file_path[MAX_FILENAME_LENGTH];
                     snprintf(file_path, sizeof(file_path), OUTPUT_DIR "quadtree.qtn");
-                    save_image_quadtree_bw(file_path, quadtree);
+                    save_image_quadtree_bw(ctx, file_path, quadtree);
                 }
                 break;
             case 3:
                 if (quadtree) {
                     char file_path[MAX_FILENAME_LENGTH];
                     snprintf(file_path, sizeof(file_path), OUTPUT_DIR "quadtree.qtc");
-                    save_image_quadtree(file_path, quadtree);
+                    save_image_quadtree(ctx, file_path, quadtree);
                 }
                 break;
             case 4:
                 if (quadtree) {
-                    draw_quadtree_with_loss(quadtree, image);
+                    draw_quadtree_with_loss(ctx, quadtree, image);
                 }
                 break;
             case 5:
                 if (quadtree) {
                     char file_path[MAX_FILENAME_LENGTH];
                     snprintf(file_path, sizeof(file_path), OUTPUT_DIR "minimized_quadtree.qtn");
-                    save_image_quadtree_bw(file_path, quadtree);
+                    save_image_quadtree_bw(ctx, file_path, quadtree);
                 }
                 break;
             case 6:
                 if (quadtree) {
                     char file_path[MAX_FILENAME_LENGTH];
                     snprintf(file_path, sizeof(file_path), OUTPUT_DIR "minimized_quadtree.qtc");
-                    save_image_quadtree(file_path, quadtree);
+                    save_image_quadtree(ctx, file_path, quadtree);
                 }
                 break;
             case 7:
@@ -69,16 +69,23 @@ void run_application(MLV_Image *image) {
                         break;
                     }
                     
-                    const char* ext = get_file_extension(image_name);
+                    const char* ext = quadtree_file_extension(image_name);
 
                     if (strcmp(ext, "qtn") == 0) {
-                        quadtree = load_image_quadtree_bw(image_name);
+                        quadtree = load_image_quadtree_bw(ctx, image_name);
                         if (quadtree) {
                             MLV_clear_window(MLV_COLOR_BLACK);
                             draw_entire_quadtree(quadtree);
                         }
+                    } else if (strcmp(ext, "qty") == 0) {
+                        YCbCrQuadtree *ycbcr = load_image_quadtree_ycbcr(ctx, image_name);
+                        if (ycbcr) {
+                            MLV_clear_window(MLV_COLOR_BLACK);
+                            draw_ycbcr_quadtree(ctx, ycbcr);
+                            free_ycbcr_quadtree(ctx, ycbcr);
+                        }
                     } else if (strcmp(ext, "qtc") == 0) {
-                        quadtree = load_image_quadtree(image_name);
+                        quadtree = load_image_quadtree(ctx, image_name);
                         if (quadtree) {
                             MLV_clear_window(MLV_COLOR_BLACK);
                             draw_entire_quadtree(quadtree);
@@ -102,5 +109,5 @@ void run_application(MLV_Image *image) {
         }
     }
 
-    if (quadtree) free_quadtree(quadtree);
+    if (quadtree) free_quadtree(ctx, quadtree);
 }
@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "../include/daemon.h"
+#include "../include/quadtree.h"
+#include "../include/ycbcr.h"
+#include "../include/raster.h"
+#include "../include/metric.h"
+#include "../include/config.h"
+#include "../include/utils.h"
+#include "../include/image.h"
+#include "../include/parallel.h"
+#include "../include/safe_alloc.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    int listen_fd;
+    const char *cache_dir;
+    QuadtreeContext *ctx;
+} Daemon;
+
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* The input is read once: the bytes that are hashed are the bytes that get
+ * encoded, even if the client rewrites the file meanwhile */
+static unsigned char* read_whole_file(const char *filename, size_t *length) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    size_t capacity = DAEMON_IO_BUFFER;
+    unsigned char *data = (unsigned char*)safe_malloc(capacity);
+    *length = 0;
+    size_t received;
+    while ((received = fread(data + *length, 1, capacity - *length, file)) > 0) {
+        *length += received;
+        if (*length == capacity) {
+            if (capacity >= DAEMON_MAX_INPUT) {
+                free(data);
+                fclose(file);
+                return NULL;
+            }
+            capacity *= 2;
+            data = (unsigned char*)safe_realloc(data, capacity);
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+/* Writes the request bytes to a private file in the cache directory. The
+ * extension is kept since loaders pick the format from it */
+static int write_snapshot(const char *cache_dir, const char *ext, const unsigned char *data,
+                          size_t length, char *path, size_t path_size) {
+    int written_path = snprintf(path, path_size, "%s/input.XXXXXX.%s", cache_dir, ext);
+    if (written_path < 0 || (size_t)written_path >= path_size) return 0;
+    int fd = mkstemps(path, (int)strlen(ext) + 1);
+    if (fd < 0) return 0;
+
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(fd, data + written, length - written);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) break;
+        written += count;
+    }
+    if (close(fd) != 0 || written != length) {
+        remove(path);
+        return 0;
+    }
+    return 1;
+}
+
+static int copy_file(const char *source, const char *destination) {
+    FILE *in = fopen(source, "rb");
+    if (!in) return 0;
+    FILE *out = fopen(destination, "wb");
+    if (!out) {
+        fclose(in);
+        return 0;
+    }
+
+    unsigned char buffer[DAEMON_IO_BUFFER];
+    size_t length;
+    int ok = 1;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        if (fwrite(buffer, 1, length, out) != length) {
+            ok = 0;
+            break;
+        }
+    }
+    fclose(in);
+    if (fclose(out) != 0) ok = 0;
+    return ok;
+}
+
+/* Publishes a result into the cache under a temporary name first, so a
+ * concurrent reader never sees a partial entry */
+static void store_in_cache(const char *result, const char *cache_path) {
+    char temp_path[MAX_FILENAME_LENGTH];
+    int written = snprintf(temp_path, sizeof(temp_path), "%s.%lu.tmp", cache_path, (unsigned long)pthread_self());
+    if (written < 0 || (size_t)written >= sizeof(temp_path)) return;
+    if (copy_file(result, temp_path)) {
+        rename(temp_path, cache_path);
+    } else {
+        remove(temp_path);
+    }
+}
+
+static int encode_to_file(QuadtreeContext *ctx, const char *input, const char *output) {
+    const char *ext = quadtree_file_extension(output);
+    PixelBuffer *image = load_source_image(ctx, input);
+    if (!image) return 0;
+
+    int saved;
+    if (strcmp(ext, "qty") == 0) {
+        YCbCrQuadtree *quadtree = build_ycbcr_quadtree(ctx, image);
+        free_pixel_buffer(ctx, image);
+        if (!quadtree) return 0;
+        saved = save_image_quadtree_ycbcr(output, quadtree);
+        free_ycbcr_quadtree(ctx, quadtree);
+    } else {
+        QuadtreeNode *quadtree = encode_quadtree(ctx, image);
+        free_pixel_buffer(ctx, image);
+        if (!quadtree) return 0;
+        if (strcmp(ext, "qtn") == 0) {
+            saved = save_image_quadtree_bw(ctx, output, quadtree);
+        } else {
+            saved = save_image_quadtree(ctx, output, quadtree);
+        }
+        free_quadtree(ctx, quadtree);
+    }
+    return saved;
+}
+
+static void handle_request(Daemon *daemon, const char *request, char *reply, size_t reply_size) {
+    /* Paths are read one character past MAX_FILENAME_LENGTH so that a path
+     * too long to use is rejected instead of silently truncated */
+    char command[16], input[MAX_FILENAME_LENGTH + 1], output[MAX_FILENAME_LENGTH + 1];
+    int size = DEFAULT_IMAGE_SIZE;
+    int fields = sscanf(request, "%15s %256s %256s %d", command, input, output, &size);
+    int encode = fields >= 3 && strcmp(command, "ENCODE") == 0;
+    int decode = fields >= 3 && strcmp(command, "DECODE") == 0;
+    if (!encode && !decode) {
+        snprintf(reply, reply_size, "ERR malformed request\n");
+        return;
+    }
+    /* The daemon does not share the client's working directory */
+    if (input[0] != '/' || output[0] != '/') {
+        snprintf(reply, reply_size, "ERR paths must be absolute\n");
+        return;
+    }
+    if (strlen(input) >= MAX_FILENAME_LENGTH || strlen(output) >= MAX_FILENAME_LENGTH) {
+        snprintf(reply, reply_size, "ERR path too long\n");
+        return;
+    }
+
+    /* Everything that changes the result is part of the key */
+    char params[128];
+    const char *ext = quadtree_file_extension(output);
+    snprintf(params, sizeof(params), "%s|%s|%s|%d|%d|%g|%g|%d", command, ext,
+             error_metric_name(daemon->ctx->metric), DEFAULT_IMAGE_SIZE, size,
+             daemon->ctx->luma_threshold, daemon->ctx->chroma_threshold, CHROMA_SUBSAMPLING);
+    size_t length;
+    unsigned char *data = read_whole_file(input, &length);
+    if (!data) {
+        snprintf(reply, reply_size, "ERR cannot read %s\n", input);
+        return;
+    }
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hash_bytes(hash, (const unsigned char*)params, strlen(params));
+    hash = hash_bytes(hash, data, length);
+
+    char cache_path[MAX_FILENAME_LENGTH];
+    int written = snprintf(cache_path, sizeof(cache_path), "%s/%016llx.%s", daemon->cache_dir,
+                           (unsigned long long)hash, ext);
+    if (written < 0 || (size_t)written >= sizeof(cache_path)) {
+        free(data);
+        snprintf(reply, reply_size, "ERR cache path too long\n");
+        return;
+    }
+
+    if (quadtree_file_exists(cache_path) && copy_file(cache_path, output)) {
+        free(data);
+        snprintf(reply, reply_size, "OK cached\n");
+        return;
+    }
+
+    char snapshot[MAX_FILENAME_LENGTH];
+    int ok = write_snapshot(daemon->cache_dir, quadtree_file_extension(input), data, length,
+                            snapshot, sizeof(snapshot));
+    free(data);
+    if (!ok) {
+        snprintf(reply, reply_size, "ERR cannot stage %s\n", input);
+        return;
+    }
+    ok = encode ? encode_to_file(daemon->ctx, snapshot, output)
+                : decode_quadtree_to_ppm(daemon->ctx, snapshot, output, size);
+    remove(snapshot);
+    if (!ok) {
+        snprintf(reply, reply_size, "ERR %s failed for %s\n", encode ? "encode" : "decode", input);
+        return;
+    }
+    store_in_cache(output, cache_path);
+    snprintf(reply, reply_size, "OK %s\n", encode ? "encoded" : "decoded");
+}
+
+static int read_line(int fd, char *line, size_t length) {
+    size_t used = 0;
+    while (used + 1 < length) {
+        ssize_t received = read(fd, line + used, 1);
+        if (received < 0) return 0;  // Includes the receive timeout
+        if (received == 0) break;
+        if (line[used] == '\n') break;
+        used++;
+    }
+    line[used] = '\0';
+    return used > 0;
+}
+
+/* Workers are started once and each blocks in accept, so a request never
+ * pays for thread creation or process startup */
+static void* daemon_worker(void *arg) {
+    Daemon *daemon = (Daemon*)arg;
+    char request[DAEMON_REQUEST_LENGTH];
+    char reply[DAEMON_REQUEST_LENGTH];
+
+    while (1) {
+        int client = accept(daemon->listen_fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // Out of descriptors or memory: wait for other clients to finish
+                usleep(DAEMON_ACCEPT_BACKOFF_US);
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        /* An idle client must not hold a worker forever */
+        struct timeval timeout = {DAEMON_READ_TIMEOUT_S, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        if (read_line(client, request, sizeof(request))) {
+            handle_request(daemon, request, reply, sizeof(reply));
+        } else {
+            snprintf(reply, sizeof(reply), "ERR empty request\n");
+        }
+        if (write(client, reply, strlen(reply)) < 0) {
+            fprintf(stderr, "Could not answer client\n");
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+int run_encode_daemon(QuadtreeContext *ctx, const char *socket_path, const char *cache_dir, int workers) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 0;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Could not create socket\n");
+        return 0;
+    }
+    unlink(socket_path);
+    /* Only the owner may connect: requests read and write files with the
+     * daemon's rights. The umask closes the window before chmod */
+    mode_t mask = umask(0077);
+    int bound = bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || chmod(socket_path, 0600) != 0 ||
+        listen(listen_fd, DAEMON_BACKLOG) != 0) {
+        fprintf(stderr, "Could not listen on %s\n", socket_path);
+        close(listen_fd);
+        return 0;
+    }
+
+    /* A client leaving early must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    Daemon daemon;
+    daemon.listen_fd = listen_fd;
+    daemon.cache_dir = cache_dir;
+    /* Requests are already spread over the daemon workers: none of them
+     * starts more threads */
+    QuadtreeContext worker_ctx = *ctx;
+    worker_ctx.threads = 1;
+    daemon.ctx = &worker_ctx;
+
+    pthread_t *threads = (pthread_t*)safe_malloc(workers * sizeof(pthread_t));
+    int started = 0;
+    while (started < workers && pthread_create(&threads[started], NULL, daemon_worker, &daemon) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Could not start daemon workers\n");
+        free(threads);
+        close(listen_fd);
+        unlink(socket_path);
+        return 0;
+    }
+    printf("Listening on %s with %d workers, cache in %s\n", socket_path, started, cache_dir);
+    fflush(stdout);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    close(listen_fd);
+    unlink(socket_path);
+    ctx->stats = worker_ctx.stats;
+    return started == workers;
+}
+
+int absolute_path(const char *path, char *resolved, size_t size) {
+    char buffer[PATH_MAX];
+    if (realpath(path, buffer)) {
+        if (strlen(buffer) >= size) return 0;
+        strcpy(resolved, buffer);
+        return 1;
+    }
+
+    /* Outputs usually don't exist yet: resolve their directory instead */
+    char directory[PATH_MAX], name[PATH_MAX];
+    if (strlen(path) >= PATH_MAX) return 0;
+    strcpy(directory, path);
+    strcpy(name, path);
+    if (!realpath(dirname(directory), buffer)) return 0;
+    int written = snprintf(resolved, size, "%s/%s", buffer, basename(name));
+    return written > 0 && (size_t)written < size;
+}
+
+int submit_daemon_request(const char *socket_path, const char *request) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Could not connect to %s\n", socket_path);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+
+    int ok = write(fd, request, strlen(request)) >= 0 && write(fd, "\n", 1) >= 0;
+    char reply[DAEMON_REQUEST_LENGTH];
+    ok = ok && read_line(fd, reply, sizeof(reply));
+    close(fd);
+
+    if (!ok) {
+        fprintf(stderr, "No answer from %s\n", socket_path);
+        return 0;
+    }
+    printf("%s\n", reply);
+    return strncmp(reply, "OK", 2) == 0;
+}
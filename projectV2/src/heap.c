@@ -1,28 +1,37 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
-#include <MLV/MLV_all.h>
 
 #include "../include/quadtree.h"
 #include "../include/heap.h"
 #include "../include/config.h"
 #include "../include/utils.h"
 
-MaxHeap* create_max_heap(int capacity) {
-    MaxHeap* heap = (MaxHeap*)safe_malloc(sizeof(MaxHeap));
-    heap->nodes = (QuadtreeNode**)safe_malloc(sizeof(QuadtreeNode*) * capacity);
+MaxHeap* create_max_heap(QuadtreeContext *ctx, int capacity) {
+    MaxHeap* heap = (MaxHeap*)quadtree_alloc(ctx, sizeof(MaxHeap));
+    if (!heap) return NULL;
+    heap->nodes = (QuadtreeNode**)quadtree_alloc(ctx, sizeof(QuadtreeNode*) * capacity);
+    if (!heap->nodes) {
+        quadtree_release(ctx, heap);
+        return NULL;
+    }
     heap->size = 0;
     heap->capacity = capacity;
     return heap;
 }
 
-void swap(QuadtreeNode** a, QuadtreeNode** b) {
+void free_max_heap(QuadtreeContext *ctx, MaxHeap* heap) {
+    if (!heap) return;
+    quadtree_release(ctx, heap->nodes);
+    quadtree_release(ctx, heap);
+}
+
+static void swap(QuadtreeNode** a, QuadtreeNode** b) {
     QuadtreeNode* temp = *a;
     *a = *b;
     *b = temp;
 }
 
-void max_heapify(MaxHeap* heap, int idx) {
+static void max_heapify(MaxHeap* heap, int idx) {
     int largest = idx;
     int left = 2 * idx + 1;
     int right = 2 * idx + 2;
@@ -39,10 +48,13 @@ void max_heapify(MaxHeap* heap, int idx) {
     }
 }
 
-void insert_max_heap(MaxHeap* heap, QuadtreeNode* node) {
+int insert_max_heap(QuadtreeContext *ctx, MaxHeap* heap, QuadtreeNode* node) {
     if (heap->size == heap->capacity) {
+        QuadtreeNode **nodes = (QuadtreeNode**)quadtree_grow(ctx, heap->nodes, heap->capacity * sizeof(QuadtreeNode*),
+                                                             heap->capacity * HEAP_GROWTH_FACTOR * sizeof(QuadtreeNode*));
+        if (!nodes) return 0;
+        heap->nodes = nodes;
         heap->capacity *= HEAP_GROWTH_FACTOR;
-        heap->nodes = (QuadtreeNode**)safe_realloc(heap->nodes, heap->capacity * sizeof(QuadtreeNode*));
     }
     heap->nodes[heap->size] = node;
     int i = heap->size;
@@ -52,9 +64,10 @@ void insert_max_heap(MaxHeap* heap, QuadtreeNode* node) {
         swap(&heap->nodes[(i - 1) / 2], &heap->nodes[i]);
         i = (i - 1) / 2;
     }
+    return 1;
 }
 
-QuadtreeNode* extract_max(MaxHeap* heap) {
+QuadtreeNode* extract_max_heap(MaxHeap* heap) {
     if (heap->size <= 0) return NULL;
     if (heap->size == 1) {
         heap->size--;
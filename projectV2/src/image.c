@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <MLV/MLV_all.h>
+
+#include "../include/image.h"
+#include "../include/quadtree.h"
+#include "../include/config.h"
+
+/* Loading goes through SDL_image's shared decoder state, which makes no
+ * thread-safety promise, so only that call is serialized. Resizing, the
+ * pixel copy and the free work on the caller's own surface and run in
+ * parallel on the pipeline and daemon workers. */
+static pthread_mutex_t mlv_lock = PTHREAD_MUTEX_INITIALIZER;
+
+PixelBuffer* load_source_image(QuadtreeContext *ctx, const char* filename) {
+    pthread_mutex_lock(&mlv_lock);
+    MLV_Image *source = MLV_load_image(filename);
+    pthread_mutex_unlock(&mlv_lock);
+    if (source == NULL) {
+        fprintf(stderr, "Could not load image %s\n", filename);
+        return NULL;
+    }
+    MLV_resize_image(source, DEFAULT_IMAGE_SIZE, DEFAULT_IMAGE_SIZE);
+
+    /* Written straight in the Morton layout the block kernels scan */
+    PixelBuffer *image = create_pixel_buffer(ctx, DEFAULT_IMAGE_SIZE, DEFAULT_IMAGE_SIZE);
+    if (image == NULL) {
+        MLV_free_image(source);
+        fprintf(stderr, "Not enough memory to load image %s\n", filename);
+        return NULL;
+    }
+    image->layout = PIXEL_LAYOUT_MORTON;
+    for (int j = 0; j < DEFAULT_IMAGE_SIZE; j++) {
+        for (int i = 0; i < DEFAULT_IMAGE_SIZE; i++) {
+            int r, g, b, a;
+            MLV_get_pixel_on_image(source, i, j, &r, &g, &b, &a);
+            uint8_t *pixel = image->pixels + morton_index(i, j) * 4;
+            pixel[0] = r;
+            pixel[1] = g;
+            pixel[2] = b;
+            pixel[3] = a;
+        }
+    }
+
+    MLV_free_image(source);
+    return image;
+}
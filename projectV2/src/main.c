@@ -1,27 +1,143 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <MLV/MLV_all.h>
 #include "../include/controller.h"
 #include "../include/config.h"
+#include "../include/metric.h"
+#include "../include/pipeline.h"
+#include "../include/raster.h"
+#include "../include/ycbcr.h"
+#include "../include/daemon.h"
+#include "../include/bottomup.h"
+#include "../include/utils.h"
+#include "../include/image.h"
 
 int main(int argc, char *argv[]) {
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+
+    if (argc >= 4 && strcmp(argv[1], "--metric") == 0) {
+        ErrorMetric metric;
+        if (!parse_error_metric(argv[2], &metric)) {
+            printf("Unknown metric %s (rgba, weighted, luma, maxabs, ycbcr)\n", argv[2]);
+            return 1;
+        }
+        ctx.metric = metric;
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--batch") == 0) {
+        PipelineConfig config = default_pipeline_config();
+        int failed;
+        int encoded = run_encode_pipeline(&ctx, argv[2], argv[3], &config, &failed);
+        if (encoded < 0) {
+            return 1;
+        }
+        printf("%d image(s) encoded, %d failed\n", encoded, failed);
+        return failed == 0 ? 0 : 1;
+    }
+
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--decode") == 0) {
+        int output_size = argc == 5 ? atoi(argv[4]) : DEFAULT_IMAGE_SIZE;
+        return decode_quadtree_to_ppm(&ctx, argv[2], argv[3], output_size) ? 0 : 1;
+    }
+
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--encode") == 0) {
+        PixelBuffer *image = load_source_image(&ctx, argv[2]);
+        if (image == NULL) {
+            return 1;
+        }
+        /* A threshold selects the single-pass bottom-up builder */
+        QuadtreeNode *quadtree;
+        if (argc == 5) {
+            ctx.threshold = atof(argv[4]);
+            quadtree = build_quadtree_bottom_up(&ctx, image);
+        } else {
+            quadtree = encode_quadtree(&ctx, image);
+        }
+        free_pixel_buffer(&ctx, image);
+        if (quadtree == NULL) {
+            printf("Could not encode %s\n", argv[2]);
+            return 1;
+        }
+        int saved;
+        if (strcmp(quadtree_file_extension(argv[3]), "qtn") == 0) {
+            saved = save_image_quadtree_bw(&ctx, argv[3], quadtree);
+        } else {
+            saved = save_image_quadtree(&ctx, argv[3], quadtree);
+        }
+        printf("%d nodes\n", count_quadtree_nodes(quadtree));
+        free_quadtree(&ctx, quadtree);
+        return saved ? 0 : 1;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--daemon") == 0) {
+        return run_encode_daemon(&ctx, argv[2], argv[3], DAEMON_WORKERS) ? 0 : 1;
+    }
+
+    if (argc >= 4 && strcmp(argv[1], "--submit") == 0) {
+        char request[DAEMON_REQUEST_LENGTH] = "";
+        char path[MAX_FILENAME_LENGTH];
+        for (int i = 3; i < argc; i++) {
+            /* The daemon runs elsewhere: input and output must be absolute */
+            const char *argument = argv[i];
+            if (i == 4 || i == 5) {
+                if (!absolute_path(argv[i], path, sizeof(path))) {
+                    printf("Cannot resolve path %s\n", argv[i]);
+                    return 1;
+                }
+                argument = path;
+            }
+            if (i > 3) strncat(request, " ", sizeof(request) - strlen(request) - 1);
+            strncat(request, argument, sizeof(request) - strlen(request) - 1);
+        }
+        return submit_daemon_request(argv[2], request) ? 0 : 1;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--ycbcr") == 0) {
+        PixelBuffer *image = load_source_image(&ctx, argv[2]);
+        if (image == NULL) {
+            return 1;
+        }
+        YCbCrQuadtree *quadtree = build_ycbcr_quadtree(&ctx, image);
+        free_pixel_buffer(&ctx, image);
+        if (quadtree == NULL) {
+            printf("Could not encode %s\n", argv[2]);
+            return 1;
+        }
+        int saved = save_image_quadtree_ycbcr(argv[3], quadtree);
+        printf("Luma: %d nodes, Cb: %d nodes, Cr: %d nodes\n",
+               count_quadtree_nodes(quadtree->luma),
+               count_quadtree_nodes(quadtree->cb),
+               count_quadtree_nodes(quadtree->cr));
+        free_ycbcr_quadtree(&ctx, quadtree);
+        return saved ? 0 : 1;
+    }
+
     if (argc != 2) {
-        printf("Usage: %s <image_file>\n", argv[0]);
+        printf("Usage: %s [--metric <rgba|weighted|luma|maxabs|ycbcr>] <image_file>\n", argv[0]);
+        printf("       %s [--metric <name>] --batch <input_dir> <output_dir>\n", argv[0]);
+        printf("       %s --decode <file.qtc|file.qtn|file.qty> <output.ppm> [size]\n", argv[0]);
+        printf("       %s [--metric <name>] --encode <image_file> <output.qtc|output.qtn> [threshold]\n", argv[0]);
+        printf("       %s --ycbcr <image_file> <output.qty>\n", argv[0]);
+        printf("       %s [--metric <name>] --daemon <socket> <cache_dir>\n", argv[0]);
+        printf("       %s --submit <socket> ENCODE|DECODE <input> <output> [size]\n", argv[0]);
         return 1;
     }
 
     MLV_create_window("Quadtree Image Approximation", NULL, WINDOW_WIDTH, DEFAULT_IMAGE_SIZE);
 
-    MLV_Image *image = MLV_load_image(argv[1]);
+    PixelBuffer *image = load_source_image(&ctx, argv[1]);
     if (image == NULL) {
-        printf("Could not load image %s\n", argv[1]);
         return 1;
     }
-    MLV_resize_image(image, DEFAULT_IMAGE_SIZE, DEFAULT_IMAGE_SIZE);
 
-    run_application(image);
+    run_application(&ctx, image);
 
-    MLV_free_image(image);
+    free_pixel_buffer(&ctx, image);
     MLV_free_window();
 
     return 0;
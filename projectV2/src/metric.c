@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../include/metric.h"
+#include "../include/config.h"
+
+static const char *metric_names[METRIC_COUNT] = {
+    "rgba", "weighted", "luma", "maxabs", "ycbcr"
+};
+
+const char* error_metric_name(ErrorMetric metric) {
+    if (metric < 0 || metric >= METRIC_COUNT) return "unknown";
+    return metric_names[metric];
+}
+
+int parse_error_metric(const char *name, ErrorMetric *metric) {
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (strcmp(name, metric_names[i]) == 0) {
+            *metric = (ErrorMetric)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Per-pixel distances, from the channel differences to the block average */
+
+static inline double pixel_error_rgba(int dr, int dg, int db, int da) {
+    return dr * dr + dg * dg + db * db + da * da;
+}
+
+static inline double pixel_error_weighted(int dr, int dg, int db, int da) {
+    return METRIC_WEIGHT_R * dr * dr + METRIC_WEIGHT_G * dg * dg +
+           METRIC_WEIGHT_B * db * db + METRIC_WEIGHT_A * da * da;
+}
+
+static inline double pixel_error_luma(int dr, int dg, int db, int da) {
+    (void)da;
+    double dy = 0.299 * dr + 0.587 * dg + 0.114 * db;
+    return dy * dy;
+}
+
+static inline double pixel_error_maxabs(int dr, int dg, int db, int da) {
+    int m = abs(dr);
+    if (abs(dg) > m) m = abs(dg);
+    if (abs(db) > m) m = abs(db);
+    if (abs(da) > m) m = abs(da);
+    return m;
+}
+
+static inline double pixel_error_ycbcr(int dr, int dg, int db, int da) {
+    /* BT.601 is linear, so the difference of the transforms is the
+     * transform of the difference */
+    double dy = 0.299 * dr + 0.587 * dg + 0.114 * db;
+    double dcb = -0.168736 * dr - 0.331264 * dg + 0.5 * db;
+    double dcr = 0.5 * dr - 0.418688 * dg - 0.081312 * db;
+    return YCBCR_LUMA_WEIGHT * dy * dy + dcb * dcb + dcr * dcr + da * da;
+}
+
+/* One block kernel per metric, each with its pixel distance inlined. The
+ * block is scanned as the contiguous run it occupies in a Morton buffer. */
+#define DEFINE_BLOCK_KERNEL(name)                                              \
+    static double block_error_##name(const PixelBuffer *image, int x, int y, int size, \
+                                     int ar, int ag, int ab, int aa) {         \
+        const uint8_t *p = pixel_at(image, x, y);                              \
+        int count = size * size;                                               \
+        double error = 0.0;                                                    \
+        for (int k = 0; k < count; k++, p += 4) {                              \
+            error += pixel_error_##name(p[0] - ar, p[1] - ag, p[2] - ab, p[3] - aa); \
+        }                                                                      \
+        return error;                                                          \
+    }
+
+DEFINE_BLOCK_KERNEL(rgba)
+DEFINE_BLOCK_KERNEL(weighted)
+DEFINE_BLOCK_KERNEL(luma)
+DEFINE_BLOCK_KERNEL(maxabs)
+DEFINE_BLOCK_KERNEL(ycbcr)
+
+double metric_block_error(ErrorMetric metric, const PixelBuffer *image, int x, int y, int size, Color avg_color) {
+    uint8_t ar, ag, ab, aa;
+    color_to_rgba(avg_color, &ar, &ag, &ab, &aa);
+
+    switch (metric) {
+        case METRIC_WEIGHTED: return block_error_weighted(image, x, y, size, ar, ag, ab, aa);
+        case METRIC_LUMA:     return block_error_luma(image, x, y, size, ar, ag, ab, aa);
+        case METRIC_MAX_ABS:  return block_error_maxabs(image, x, y, size, ar, ag, ab, aa);
+        case METRIC_YCBCR:    return block_error_ycbcr(image, x, y, size, ar, ag, ab, aa);
+        case METRIC_RGBA_SQUARED:
+        default:              return block_error_rgba(image, x, y, size, ar, ag, ab, aa);
+    }
+}
+
+double metric_color_distance(ErrorMetric metric, Color c1, Color c2) {
+    uint8_t r1, g1, b1, a1;
+    uint8_t r2, g2, b2, a2;
+    color_to_rgba(c1, &r1, &g1, &b1, &a1);
+    color_to_rgba(c2, &r2, &g2, &b2, &a2);
+
+    int dr = r1 - r2, dg = g1 - g2, db = b1 - b2, da = a1 - a2;
+
+    /* Squared metrics are brought back to a linear scale so MERGE_THRESHOLD
+     * keeps the same meaning whatever the metric */
+    switch (metric) {
+        case METRIC_WEIGHTED: return sqrt(pixel_error_weighted(dr, dg, db, da));
+        case METRIC_LUMA:     return sqrt(pixel_error_luma(dr, dg, db, da));
+        case METRIC_MAX_ABS:  return pixel_error_maxabs(dr, dg, db, da);
+        case METRIC_YCBCR:    return sqrt(pixel_error_ycbcr(dr, dg, db, da));
+        case METRIC_RGBA_SQUARED:
+        default:              return sqrt(pixel_error_rgba(dr, dg, db, da));
+    }
+}
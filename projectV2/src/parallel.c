@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../include/parallel.h"
+#include "../include/quadtree.h"
+#include "../include/config.h"
+#include "../include/utils.h"
+
+typedef struct {
+    QuadtreeNode **nodes;
+    int count;
+    int capacity;
+} Frontier;
+
+typedef struct {
+    Frontier *frontier;
+    int next;
+    pthread_mutex_t lock;
+    void (*task)(void *context, int index);
+    void *context;
+} TaskPool;
+
+/* Subtrees rooted at depth PARALLEL_SPLIT_DEPTH, in pre-order */
+static int collect_frontier(QuadtreeContext *ctx, QuadtreeNode *node, int depth, Frontier *frontier) {
+    if (!node) return 1;
+    if (depth == PARALLEL_SPLIT_DEPTH) {
+        if (frontier->count == frontier->capacity) {
+            QuadtreeNode **nodes = (QuadtreeNode**)quadtree_grow(ctx, frontier->nodes,
+                                                                 frontier->capacity * sizeof(QuadtreeNode*),
+                                                                 frontier->capacity * HEAP_GROWTH_FACTOR * sizeof(QuadtreeNode*));
+            if (!nodes) return 0;
+            frontier->nodes = nodes;
+            frontier->capacity *= HEAP_GROWTH_FACTOR;
+        }
+        frontier->nodes[frontier->count++] = node;
+        return 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (!collect_frontier(ctx, node->children[i], depth + 1, frontier)) return 0;
+    }
+    return 1;
+}
+
+static void free_frontier(QuadtreeContext *ctx, Frontier *frontier) {
+    if (!frontier) return;
+    quadtree_release(ctx, frontier->nodes);
+    quadtree_release(ctx, frontier);
+}
+
+/* NULL when out of memory: every pass then falls back to its serial version */
+static Frontier* create_frontier(QuadtreeContext *ctx, QuadtreeNode *root) {
+    Frontier *frontier = (Frontier*)quadtree_alloc(ctx, sizeof(Frontier));
+    if (!frontier) return NULL;
+    frontier->capacity = 64;
+    frontier->count = 0;
+    frontier->nodes = (QuadtreeNode**)quadtree_alloc(ctx, frontier->capacity * sizeof(QuadtreeNode*));
+    if (!frontier->nodes || !collect_frontier(ctx, root, 0, frontier)) {
+        free_frontier(ctx, frontier);
+        return NULL;
+    }
+    return frontier;
+}
+
+static void run_tasks(TaskPool *pool) {
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (index >= pool->frontier->count) break;
+        pool->task(pool->context, index);
+    }
+}
+
+static void* task_worker(void *arg) {
+    run_tasks((TaskPool*)arg);
+    return NULL;
+}
+
+/* Runs task once per frontier subtree, spread over up to ctx->threads workers */
+static void run_frontier_tasks(QuadtreeContext *ctx, Frontier *frontier, void (*task)(void*, int), void *context) {
+    TaskPool pool;
+    pool.frontier = frontier;
+    pool.next = 0;
+    pool.task = task;
+    pool.context = context;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    int threads = ctx->threads;
+    if (threads > frontier->count) threads = frontier->count;
+    pthread_t *workers = NULL;
+    if (threads > 1) {
+        workers = (pthread_t*)quadtree_alloc(ctx, (threads - 1) * sizeof(pthread_t));
+    }
+    if (!workers) {
+        run_tasks(&pool);
+    } else {
+        /* The calling thread takes its share too, and picks up whatever
+         * threads that could not be started would have done */
+        int started = 0;
+        while (started < threads - 1 && pthread_create(&workers[started], NULL, task_worker, &pool) == 0) {
+            started++;
+        }
+        run_tasks(&pool);
+        for (int i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        quadtree_release(ctx, workers);
+    }
+    pthread_mutex_destroy(&pool.lock);
+}
+
+/* Minimize */
+
+typedef struct {
+    QuadtreeContext *ctx;
+    Frontier *frontier;
+    const PixelBuffer *image;
+} MinimizeContext;
+
+static void minimize_task(void *context, int index) {
+    MinimizeContext *minimize = (MinimizeContext*)context;
+    minimize_with_loss(minimize->ctx, minimize->frontier->nodes[index], minimize->image);
+}
+
+/* Post-order over the nodes above the cut, whose subtrees are done */
+static void minimize_top(QuadtreeContext *ctx, QuadtreeNode *node, const PixelBuffer *image, int depth) {
+    if (!node || depth == PARALLEL_SPLIT_DEPTH) return;
+    for (int i = 0; i < 4; i++) {
+        minimize_top(ctx, node->children[i], image, depth + 1);
+    }
+    minimize_node(ctx, node, image);
+}
+
+int minimize_with_loss_parallel(QuadtreeContext *ctx, QuadtreeNode *root, const PixelBuffer *image) {
+    if (!root) return 1;
+    if (!validate_pixel_buffer(image)) return 0;
+    PixelBuffer *owned;
+    image = ingest_pixel_buffer(ctx, image, &owned);
+    if (!image) return 0;
+
+    Frontier *frontier = create_frontier(ctx, root);
+    if (frontier) {
+        MinimizeContext context = {ctx, frontier, image};
+        run_frontier_tasks(ctx, frontier, minimize_task, &context);
+        minimize_top(ctx, root, image, 0);
+        free_frontier(ctx, frontier);
+    } else {
+        minimize_with_loss(ctx, root, image);
+    }
+
+    free_pixel_buffer(ctx, owned);
+    return 1;
+}
+
+/* Serialize */
+
+typedef struct {
+    Frontier *frontier;
+    SaveFormat format;
+    char **buffers;
+    size_t *lengths;
+    int failed;
+} SaveContext;
+
+static void save_subtree(FILE *file, QuadtreeNode *node, SaveFormat format) {
+    switch (format) {
+        case SAVE_FORMAT_QTN:   save_quadtree_binary_bw(file, node); break;
+        case SAVE_FORMAT_GRAPH: save_quadtree_as_graph(file, node); break;
+        case SAVE_FORMAT_QTC:
+        default:                save_quadtree_binary(file, node); break;
+    }
+}
+
+/* Writes what the serial savers write for an internal node before its children */
+static void save_internal_header(FILE *file, QuadtreeNode *node, SaveFormat format) {
+    if (format == SAVE_FORMAT_GRAPH) {
+        fprintf(file, "%d %d %d %d %d\n", node->id, node->children[0] ? node->children[0]->id : -1,
+                                           node->children[1] ? node->children[1]->id : -1,
+                                           node->children[2] ? node->children[2]->id : -1,
+                                           node->children[3] ? node->children[3]->id : -1);
+    } else {
+        int is_leaf = 0;
+        fwrite(&is_leaf, sizeof(int), 1, file);
+    }
+}
+
+static void save_task(void *context, int index) {
+    SaveContext *save = (SaveContext*)context;
+    /* Memory streams are allocated by libc, outside ctx->allocator */
+    FILE *buffer = open_memstream(&save->buffers[index], &save->lengths[index]);
+    if (!buffer) {
+        __atomic_store_n(&save->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    save_subtree(buffer, save->frontier->nodes[index], save->format);
+    if (fclose(buffer) != 0) {
+        __atomic_store_n(&save->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Walks the nodes above the cut in pre-order and splices the per-subtree
+ * buffers in, which reproduces the serial byte stream exactly */
+static void save_top(FILE *file, QuadtreeNode *node, int depth, SaveContext *save, int *next_buffer) {
+    if (!node) return;
+    if (depth == PARALLEL_SPLIT_DEPTH) {
+        int index = (*next_buffer)++;
+        fwrite(save->buffers[index], 1, save->lengths[index], file);
+        return;
+    }
+    if (node->children[0] == NULL) {
+        save_subtree(file, node, save->format);
+        return;
+    }
+    save_internal_header(file, node, save->format);
+    for (int i = 0; i < 4; i++) {
+        save_top(file, node->children[i], depth + 1, save, next_buffer);
+    }
+}
+
+/* Nothing reaches file before every subtree buffer is ready, so any
+ * failure on the way falls back to the serial writer */
+void save_quadtree_parallel(QuadtreeContext *ctx, FILE *file, QuadtreeNode *root, SaveFormat format) {
+    if (!root) return;
+    Frontier *frontier = NULL;
+    if (ctx->threads > 1) {
+        frontier = create_frontier(ctx, root);
+    }
+    if (!frontier || frontier->count < 2) {
+        free_frontier(ctx, frontier);
+        save_subtree(file, root, format);
+        return;
+    }
+
+    SaveContext context;
+    context.frontier = frontier;
+    context.format = format;
+    context.failed = 0;
+    context.buffers = (char**)quadtree_alloc(ctx, frontier->count * sizeof(char*));
+    context.lengths = (size_t*)quadtree_alloc(ctx, frontier->count * sizeof(size_t));
+    if (context.buffers) {
+        memset(context.buffers, 0, frontier->count * sizeof(char*));
+    }
+    if (context.buffers && context.lengths) {
+        run_frontier_tasks(ctx, frontier, save_task, &context);
+    } else {
+        context.failed = 1;
+    }
+
+    if (context.failed) {
+        save_subtree(file, root, format);
+    } else {
+        int next_buffer = 0;
+        save_top(file, root, 0, &context, &next_buffer);
+    }
+
+    for (int i = 0; context.buffers && i < frontier->count; i++) {
+        free(context.buffers[i]);
+    }
+    quadtree_release(ctx, context.buffers);
+    quadtree_release(ctx, context.lengths);
+    free_frontier(ctx, frontier);
+}
+
+/* Ids */
+
+typedef struct {
+    Frontier *frontier;
+    int *sizes;
+} IdContext;
+
+static void count_task(void *context, int index) {
+    IdContext *ids = (IdContext*)context;
+    ids->sizes[index] = count_quadtree_nodes(ids->frontier->nodes[index]);
+}
+
+static void assign_task(void *context, int index) {
+    IdContext *ids = (IdContext*)context;
+    int current_id = ids->sizes[index];
+    assign_ids(ids->frontier->nodes[index], &current_id);
+}
+
+/* Numbers the nodes above the cut in pre-order and turns each subtree size
+ * into the first id of that subtree (exclusive prefix sum) */
+static void assign_top(QuadtreeNode *node, int depth, IdContext *ids, int *next_subtree, int *current_id) {
+    if (!node) return;
+    if (depth == PARALLEL_SPLIT_DEPTH) {
+        int index = (*next_subtree)++;
+        int size = ids->sizes[index];
+        ids->sizes[index] = *current_id;
+        *current_id += size;
+        return;
+    }
+    node->id = (*current_id)++;
+    for (int i = 0; i < 4; i++) {
+        assign_top(node->children[i], depth + 1, ids, next_subtree, current_id);
+    }
+}
+
+void assign_ids_parallel(QuadtreeContext *ctx, QuadtreeNode *root) {
+    if (!root) return;
+    Frontier *frontier = create_frontier(ctx, root);
+    IdContext context;
+    context.sizes = frontier ? (int*)quadtree_alloc(ctx, (frontier->count + 1) * sizeof(int)) : NULL;
+    if (!context.sizes) {
+        free_frontier(ctx, frontier);
+        int current_id = 0;
+        assign_ids(root, &current_id);
+        return;
+    }
+
+    context.frontier = frontier;
+    run_frontier_tasks(ctx, frontier, count_task, &context);
+
+    int next_subtree = 0;
+    int current_id = 0;
+    assign_top(root, 0, &context, &next_subtree, &current_id);
+    run_frontier_tasks(ctx, frontier, assign_task, &context);
+
+    quadtree_release(ctx, context.sizes);
+    free_frontier(ctx, frontier);
+}
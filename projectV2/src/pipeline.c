@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "../include/pipeline.h"
+#include "../include/quadtree.h"
+#include "../include/config.h"
+#include "../include/utils.h"
+#include "../include/image.h"
+#include "../include/parallel.h"
+#include "../include/safe_alloc.h"
+
+typedef struct {
+    char input[MAX_FILENAME_LENGTH];
+    char output[MAX_FILENAME_LENGTH];
+    PixelBuffer *image;
+    QuadtreeNode *quadtree;
+} EncodeJob;
+
+typedef struct {
+    char **inputs;
+    int input_count;
+    int next_input;
+    int encoded;
+    int failed;
+    const char *input_dir;
+    const char *output_dir;
+    QuadtreeContext *ctx;
+    pthread_mutex_t lock;
+    BoundedQueue *build_queue;
+    BoundedQueue *save_queue;
+} Pipeline;
+
+BoundedQueue* create_bounded_queue(int capacity, int producers) {
+    BoundedQueue *queue = (BoundedQueue*)safe_malloc(sizeof(BoundedQueue));
+    queue->items = (void**)safe_malloc(capacity * sizeof(void*));
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->open_producers = producers;
+    queue->aborted = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return queue;
+}
+
+void free_bounded_queue(BoundedQueue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
+
+/* Returns 0 without taking the item if the queue was aborted */
+int push_bounded_queue(BoundedQueue *queue, void *item) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity && !queue->aborted) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->aborted) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+/* Returns NULL once the queue is empty and all producers are done, or as
+ * soon as it is aborted */
+void* pop_bounded_queue(BoundedQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && queue->open_producers > 0 && !queue->aborted) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    void *item = NULL;
+    if (queue->count > 0 && !queue->aborted) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void close_bounded_queue(BoundedQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->open_producers--;
+    if (queue->open_producers <= 0) {
+        pthread_cond_broadcast(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Wakes every waiting producer and consumer; items still queued are left
+ * for the owner to drain with drain_bounded_queue */
+void abort_bounded_queue(BoundedQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->aborted = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Removes the next item regardless of producers or abort, NULL if empty */
+void* drain_bounded_queue(BoundedQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    void *item = NULL;
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+PipelineConfig default_pipeline_config(void) {
+    PipelineConfig config;
+    config.decode_workers = PIPELINE_DECODE_WORKERS;
+    config.build_workers = PIPELINE_BUILD_WORKERS;
+    config.save_workers = PIPELINE_SAVE_WORKERS;
+    config.queue_capacity = PIPELINE_QUEUE_CAPACITY;
+    return config;
+}
+
+static void count_failure(Pipeline *pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->failed++;
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+static void discard_job(Pipeline *pipeline, EncodeJob *job) {
+    free_pixel_buffer(pipeline->ctx, job->image);
+    free_quadtree(pipeline->ctx, job->quadtree);
+    free(job);
+}
+
+/* Stage 1: load and resize the next image of the directory */
+static void* decode_stage(void *arg) {
+    Pipeline *pipeline = (Pipeline*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&pipeline->lock);
+        int index = pipeline->next_input++;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (index >= pipeline->input_count) break;
+
+        EncodeJob *job = (EncodeJob*)safe_malloc(sizeof(EncodeJob));
+        const char *name = pipeline->inputs[index];
+        snprintf(job->input, sizeof(job->input), "%s/%s", pipeline->input_dir, name);
+
+        /* Output keeps the image name with the .qtc extension */
+        const char *dot = strrchr(name, '.');
+        int stem_length = dot && dot != name ? (int)(dot - name) : (int)strlen(name);
+        snprintf(job->output, sizeof(job->output), "%s/%.*s.qtc", pipeline->output_dir, stem_length, name);
+
+        job->image = load_source_image(pipeline->ctx, job->input);
+        job->quadtree = NULL;
+        if (!job->image) {
+            count_failure(pipeline);
+            free(job);
+            continue;
+        }
+        if (!push_bounded_queue(pipeline->build_queue, job)) {
+            discard_job(pipeline, job);
+            break;
+        }
+    }
+
+    close_bounded_queue(pipeline->build_queue);
+    return NULL;
+}
+
+/* Stage 2: build the quadtree, the pixels are no longer needed afterwards */
+static void* build_stage(void *arg) {
+    Pipeline *pipeline = (Pipeline*)arg;
+    EncodeJob *job;
+
+    while ((job = (EncodeJob*)pop_bounded_queue(pipeline->build_queue)) != NULL) {
+        job->quadtree = encode_quadtree(pipeline->ctx, job->image);
+        free_pixel_buffer(pipeline->ctx, job->image);
+        job->image = NULL;
+        if (!job->quadtree) {
+            fprintf(stderr, "Could not encode %s\n", job->input);
+            count_failure(pipeline);
+            free(job);
+            continue;
+        }
+        if (!push_bounded_queue(pipeline->save_queue, job)) {
+            discard_job(pipeline, job);
+            break;
+        }
+    }
+
+    close_bounded_queue(pipeline->save_queue);
+    return NULL;
+}
+
+/* Stage 3: serialize to .qtc */
+static void* save_stage(void *arg) {
+    Pipeline *pipeline = (Pipeline*)arg;
+    EncodeJob *job;
+
+    while ((job = (EncodeJob*)pop_bounded_queue(pipeline->save_queue)) != NULL) {
+        int saved = save_image_quadtree(pipeline->ctx, job->output, job->quadtree);
+        free_quadtree(pipeline->ctx, job->quadtree);
+        if (saved) {
+            printf("Encoded %s -> %s\n", job->input, job->output);
+            pthread_mutex_lock(&pipeline->lock);
+            pipeline->encoded++;
+            pthread_mutex_unlock(&pipeline->lock);
+        } else {
+            count_failure(pipeline);
+        }
+        free(job);
+    }
+    return NULL;
+}
+
+static char** list_directory(const char *path, int *count) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "Could not open directory: %s\n", path);
+        *count = 0;
+        return NULL;
+    }
+
+    int capacity = DEFAULT_HEAP_CAPACITY;
+    char **names = (char**)safe_malloc(capacity * sizeof(char*));
+    *count = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (*count == capacity) {
+            capacity *= HEAP_GROWTH_FACTOR;
+            names = (char**)safe_realloc(names, capacity * sizeof(char*));
+        }
+        names[*count] = (char*)safe_malloc(strlen(entry->d_name) + 1);
+        strcpy(names[*count], entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+    return names;
+}
+
+/* Returns how many workers actually started */
+static int run_stage(pthread_t *threads, int workers, void* (*stage)(void*), Pipeline *pipeline) {
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&threads[i], NULL, stage, pipeline) != 0) {
+            fprintf(stderr, "Could not start pipeline worker\n");
+            return i;
+        }
+    }
+    return workers;
+}
+
+static void join_stage(pthread_t *threads, int workers) {
+    for (int i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/* Every stage shares ctx, whose allocator must then be thread-safe. The
+ * stages run on a copy with threads = 1: images are already spread over the
+ * stage workers. Its stats are copied back into ctx at the end */
+/* Returns the number of images encoded, or -1 if the pipeline could not run.
+ * *failures receives the number of inputs that could not be loaded, encoded
+ * or written */
+int run_encode_pipeline(QuadtreeContext *ctx, const char *input_dir, const char *output_dir,
+                        const PipelineConfig *config, int *failures) {
+    *failures = 0;
+    if (config->decode_workers < 1 || config->build_workers < 1 || config->save_workers < 1 ||
+        config->queue_capacity < 1) {
+        fprintf(stderr, "Every pipeline stage needs at least one worker and queue slot\n");
+        return -1;
+    }
+
+    Pipeline pipeline;
+    pipeline.inputs = list_directory(input_dir, &pipeline.input_count);
+    if (!pipeline.inputs) return -1;
+
+    pipeline.next_input = 0;
+    pipeline.encoded = 0;
+    pipeline.failed = 0;
+    pipeline.input_dir = input_dir;
+    pipeline.output_dir = output_dir;
+    QuadtreeContext stage_ctx = *ctx;
+    stage_ctx.threads = 1;
+    pipeline.ctx = &stage_ctx;
+    pthread_mutex_init(&pipeline.lock, NULL);
+
+    /* Each queue stays open until every worker of the stage feeding it exits */
+    pipeline.build_queue = create_bounded_queue(config->queue_capacity, config->decode_workers);
+    pipeline.save_queue = create_bounded_queue(config->queue_capacity, config->build_workers);
+
+    pthread_t *decoders = (pthread_t*)safe_malloc(config->decode_workers * sizeof(pthread_t));
+    pthread_t *builders = (pthread_t*)safe_malloc(config->build_workers * sizeof(pthread_t));
+    pthread_t *savers = (pthread_t*)safe_malloc(config->save_workers * sizeof(pthread_t));
+
+    int decoding = run_stage(decoders, config->decode_workers, decode_stage, &pipeline);
+    int building = 0, saving = 0;
+    if (decoding == config->decode_workers) {
+        building = run_stage(builders, config->build_workers, build_stage, &pipeline);
+    }
+    if (building == config->build_workers) {
+        saving = run_stage(savers, config->save_workers, save_stage, &pipeline);
+    }
+
+    /* A stage short of workers would leave its neighbours blocked forever:
+     * stop everything and drop the jobs in flight */
+    int failed = saving != config->save_workers;
+    if (failed) {
+        abort_bounded_queue(pipeline.build_queue);
+        abort_bounded_queue(pipeline.save_queue);
+    }
+
+    join_stage(decoders, decoding);
+    join_stage(builders, building);
+    join_stage(savers, saving);
+
+    EncodeJob *job;
+    while ((job = (EncodeJob*)drain_bounded_queue(pipeline.build_queue)) != NULL) {
+        discard_job(&pipeline, job);
+    }
+    while ((job = (EncodeJob*)drain_bounded_queue(pipeline.save_queue)) != NULL) {
+        discard_job(&pipeline, job);
+    }
+
+    free(decoders);
+    free(builders);
+    free(savers);
+    free_bounded_queue(pipeline.build_queue);
+    free_bounded_queue(pipeline.save_queue);
+    pthread_mutex_destroy(&pipeline.lock);
+    for (int i = 0; i < pipeline.input_count; i++) {
+        free(pipeline.inputs[i]);
+    }
+    free(pipeline.inputs);
+
+    ctx->stats = stage_ctx.stats;
+    *failures = pipeline.failed;
+    return failed ? -1 : pipeline.encoded;
+}
@@ -1,65 +1,147 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include <MLV/MLV_all.h>
+#include <limits.h>
 
 #include "../include/quadtree.h"
 #include "../include/heap.h"
-#include "../include/view.h"
 #include "../include/config.h"
 #include "../include/utils.h"
+#include "../include/metric.h"
+#include "../include/parallel.h"
 
-MLV_Color average_color(MLV_Image *image, int x, int y, int size) {
-    int r = 0, g = 0, b = 0, a = 0, count = 0;
-    for (int i = x; i < x + size; i++) {
-        for (int j = y; j < y + size; j++) {
-            int pr, pg, pb, pa;
-            MLV_get_pixel_on_image(image, i, j, &pr, &pg, &pb, &pa);
-            r += pr;
-            g += pg;
-            b += pb;
-            a += pa;
-            count++;
-        }
-    }
-    return MLV_rgba(r / count, g / count, b / count, a / count);
+/* Statistics may be updated from the workers of the parallel passes */
+#define STATS_ADD(ctx, field, n) __atomic_fetch_add(&(ctx)->stats.field, (n), __ATOMIC_RELAXED)
+
+static void* default_alloc(void *user, size_t size) {
+    (void)user;
+    return malloc(size);
 }
 
-double color_distance(MLV_Color c1, MLV_Color c2) {
-    Uint8 r1, g1, b1, a1;
-    Uint8 r2, g2, b2, a2;
-    MLV_convert_color_to_rgba(c1, &r1, &g1, &b1, &a1);
-    MLV_convert_color_to_rgba(c2, &r2, &g2, &b2, &a2);
+static void default_release(void *user, void *ptr) {
+    (void)user;
+    free(ptr);
+}
+
+void init_quadtree_context(QuadtreeContext *ctx) {
+    memset(ctx, 0, sizeof(QuadtreeContext));
+    ctx->allocator.alloc = default_alloc;
+    ctx->allocator.release = default_release;
+    ctx->allocator.user = NULL;
+    ctx->metric = DEFAULT_ERROR_METRIC;
+    ctx->threshold = BOTTOM_UP_ERROR_THRESHOLD;
+    ctx->merge_threshold = MERGE_THRESHOLD;
+    ctx->luma_threshold = LUMA_ERROR_THRESHOLD;
+    ctx->chroma_threshold = CHROMA_ERROR_THRESHOLD;
+    ctx->threads = PARALLEL_THREADS;
+}
 
-    return sqrt((r1 - r2) * (r1 - r2) +
-                (g1 - g2) * (g1 - g2) +
-                (b1 - b2) * (b1 - b2) +
-                (a1 - a2) * (a1 - a2));
+void* quadtree_alloc(QuadtreeContext *ctx, size_t size) {
+    return ctx->allocator.alloc(ctx->allocator.user, size);
 }
 
-double calculate_error(MLV_Image *image, int x, int y, int size, MLV_Color avg_color) {
-    double error = 0.0;
-    Uint8 ar, ag, ab, aa;
-    MLV_convert_color_to_rgba(avg_color, &ar, &ag, &ab, &aa);
+void* quadtree_grow(QuadtreeContext *ctx, void *ptr, size_t old_size, size_t new_size) {
+    void *grown = quadtree_alloc(ctx, new_size);
+    if (!grown) return NULL;
+    memcpy(grown, ptr, old_size);
+    quadtree_release(ctx, ptr);
+    return grown;
+}
 
-    for (int i = x; i < x + size; i++) {
-        for (int j = y; j < y + size; j++) {
-            int pr, pg, pb, pa;
-            MLV_get_pixel_on_image(image, i, j, &pr, &pg, &pb, &pa);
+void quadtree_release(QuadtreeContext *ctx, void *ptr) {
+    if (ptr) ctx->allocator.release(ctx->allocator.user, ptr);
+}
+
+PixelBuffer* create_pixel_buffer(QuadtreeContext *ctx, int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    PixelBuffer *image = (PixelBuffer*)quadtree_alloc(ctx, sizeof(PixelBuffer));
+    if (!image) return NULL;
+    image->width = width;
+    image->height = height;
+    image->layout = PIXEL_LAYOUT_ROW_MAJOR;
+    image->pixels = (uint8_t*)quadtree_alloc(ctx, (size_t)width * height * 4);
+    if (!image->pixels) {
+        quadtree_release(ctx, image);
+        return NULL;
+    }
+    return image;
+}
+
+int validate_pixel_buffer(const PixelBuffer *image) {
+    if (!image || !image->pixels) {
+        fprintf(stderr, "Error: No image\n");
+        return 0;
+    }
+    int size = image->width;
+    if (size != image->height || size <= 0 || size > MAX_IMAGE_SIZE || (size & (size - 1)) != 0) {
+        fprintf(stderr, "Error: Image must be a square with a power-of-two side: %dx%d\n",
+                image->width, image->height);
+        return 0;
+    }
+    return 1;
+}
 
-            int dr = pr - ar;
-            int dg = pg - ag;
-            int db = pb - ab;
-            int da = pa - aa;
-            /* Optimization: Use squared distance (sqrt removed for performance) */
-            error += (dr * dr + dg * dg + db * db + da * da);
+/* Z-order only covers square power-of-two images: anything else is
+ * rejected rather than written out of bounds */
+PixelBuffer* morton_pixel_buffer(QuadtreeContext *ctx, const PixelBuffer *image) {
+    if (!validate_pixel_buffer(image)) return NULL;
+    PixelBuffer *morton = create_pixel_buffer(ctx, image->width, image->height);
+    if (!morton) return NULL;
+    morton->layout = PIXEL_LAYOUT_MORTON;
+    for (int j = 0; j < image->height; j++) {
+        for (int i = 0; i < image->width; i++) {
+            memcpy(morton->pixels + morton_index(i, j) * 4, pixel_at(image, i, j), 4);
         }
     }
-    return error;
+    return morton;
+}
+
+/* Entry points take either layout; row-major input is converted once here
+ * and *owned is set to the copy the caller must free. NULL if the image
+ * isn't a power-of-two square or the copy can't be allocated */
+const PixelBuffer* ingest_pixel_buffer(QuadtreeContext *ctx, const PixelBuffer *image, PixelBuffer **owned) {
+    *owned = NULL;
+    if (!validate_pixel_buffer(image)) return NULL;
+    if (image->layout == PIXEL_LAYOUT_MORTON) return image;
+    *owned = morton_pixel_buffer(ctx, image);
+    return *owned;
 }
 
-QuadtreeNode* create_quadtree_node(int x, int y, int size, MLV_Color color, double error) {
-    QuadtreeNode* node = (QuadtreeNode*)safe_malloc(sizeof(QuadtreeNode));
+void free_pixel_buffer(QuadtreeContext *ctx, PixelBuffer *image) {
+    if (!image) return;
+    quadtree_release(ctx, image->pixels);
+    quadtree_release(ctx, image);
+}
+
+/* The block is one contiguous run of the Morton buffer. 64-bit sums: a
+ * 4096x4096 block already overflows an int */
+Color average_color(const PixelBuffer *image, int x, int y, int size) {
+    const uint8_t *pixel = pixel_at(image, x, y);
+    uint64_t count = (uint64_t)size * size;
+    uint64_t r = 0, g = 0, b = 0, a = 0;
+    for (uint64_t k = 0; k < count; k++, pixel += 4) {
+        r += pixel[0];
+        g += pixel[1];
+        b += pixel[2];
+        a += pixel[3];
+    }
+    return rgba_color((uint8_t)(r / count), (uint8_t)(g / count), (uint8_t)(b / count), (uint8_t)(a / count));
+}
+
+double color_distance(QuadtreeContext *ctx, Color c1, Color c2) {
+    return metric_color_distance(ctx->metric, c1, c2);
+}
+
+double calculate_error(QuadtreeContext *ctx, const PixelBuffer *image, int x, int y, int size, Color avg_color) {
+    /* Dispatch once per block to the kernel specialized for the metric */
+    return metric_block_error(ctx->metric, image, x, y, size, avg_color);
+}
+
+QuadtreeNode* create_quadtree_node(QuadtreeContext *ctx, int x, int y, int size, Color color, double error) {
+    QuadtreeNode* node = (QuadtreeNode*)quadtree_alloc(ctx, sizeof(QuadtreeNode));
+    if (!node) return NULL;
+    STATS_ADD(ctx, nodes_created, 1);
     node->x = x;
     node->y = y;
     node->size = size;
@@ -72,39 +154,58 @@ QuadtreeNode* create_quadtree_node(int x, int y, int size, MLV_Color color, doub
     return node;
 }
 
-QuadtreeNode* build_quadtree(MLV_Image *image, int x, int y, int size, MaxHeap* heap) {
-    MLV_Color avg_color = average_color(image, x, y, size);
-    double error = calculate_error(image, x, y, size, avg_color);
-    QuadtreeNode *node = create_quadtree_node(x, y, size, avg_color, error);
+QuadtreeNode* build_quadtree(QuadtreeContext *ctx, const PixelBuffer *image, int x, int y, int size, MaxHeap* heap) {
+    Color avg_color = average_color(image, x, y, size);
+    double error = calculate_error(ctx, image, x, y, size, avg_color);
+    QuadtreeNode *node = create_quadtree_node(ctx, x, y, size, avg_color, error);
+    if (!node) return NULL;
 
-    insert_max_heap(heap, node);
+    if (!insert_max_heap(ctx, heap, node)) {
+        free_quadtree(ctx, node);
+        return NULL;
+    }
     return node;
 }
 
-void free_quadtree(QuadtreeNode *node) {
+void free_quadtree(QuadtreeContext *ctx, QuadtreeNode *node) {
     if (!node) return;
     for (int i = 0; i < 4; i++) {
-        free_quadtree(node->children[i]);
+        free_quadtree(ctx, node->children[i]);
     }
-    free(node);
+    quadtree_release(ctx, node);
+    STATS_ADD(ctx, nodes_freed, 1);
 }
 
-void minimize_with_loss(QuadtreeNode* root, MLV_Image *image) {
-    if (!root) return;
-
+static void minimize_subtree(QuadtreeContext *ctx, QuadtreeNode* root, const PixelBuffer *image) {
     for (int i = 0; i < 4; i++) {
         if (root->children[i]) {
-            minimize_with_loss(root->children[i], image);
+            minimize_subtree(ctx, root->children[i], image);
         }
     }
+    minimize_node(ctx, root, image);
+}
+
+int minimize_with_loss(QuadtreeContext *ctx, QuadtreeNode* root, const PixelBuffer *image) {
+    if (!root) return 1;
+    if (!validate_pixel_buffer(image)) return 0;
+
+    PixelBuffer *owned;
+    image = ingest_pixel_buffer(ctx, image, &owned);
+    if (!image) return 0;
+    minimize_subtree(ctx, root, image);
+    free_pixel_buffer(ctx, owned);
+    return 1;
+}
 
+/* Merge step of minimize_with_loss for one node, children already minimized */
+void minimize_node(QuadtreeContext *ctx, QuadtreeNode* root, const PixelBuffer *image) {
     double min_distance = INFINITY;
     int merge_index1 = -1, merge_index2 = -1;
 
     for (int i = 0; i < 4; i++) {
         for (int j = i + 1; j < 4; j++) {
             if (root->children[i] && root->children[j]) {
-                double distance = quadtree_distance(root->children[i], root->children[j]);
+                double distance = quadtree_distance(ctx, root->children[i], root->children[j]);
                 if (distance < min_distance) {
                     min_distance = distance;
                     merge_index1 = i;
@@ -114,62 +215,88 @@ void minimize_with_loss(QuadtreeNode* root, MLV_Image *image) {
         }
     }
 
-    if (merge_index1 != -1 && merge_index2 != -1 && min_distance < MERGE_THRESHOLD) {
-        free_quadtree(root->children[merge_index2]);
+    if (merge_index1 != -1 && merge_index2 != -1 && min_distance < ctx->merge_threshold) {
+        free_quadtree(ctx, root->children[merge_index2]);
         root->children[merge_index2] = NULL;
         root->color = average_color(image, root->x, root->y, root->size);
         root->error = 0.0;
-        printf("Minimized node at (%d, %d) with size %d\n", root->x, root->y, root->size);
+        STATS_ADD(ctx, merges, 1);
     }
 }
 
-double quadtree_distance(QuadtreeNode* t1, QuadtreeNode* t2) {
+double quadtree_distance(QuadtreeContext *ctx, QuadtreeNode* t1, QuadtreeNode* t2) {
     if (t1 == NULL && t2 == NULL) return 0.0;
     if (t1 == NULL || t2 == NULL) return INFINITY;
     
     if (t1->children[0] == NULL && t2->children[0] == NULL) {
-        return color_distance(t1->color, t2->color);
+        return color_distance(ctx, t1->color, t2->color);
     } else {
         double distance = 0.0;
         for (int i = 0; i < 4; i++) {
-            distance += quadtree_distance(t1->children[i], t2->children[i]);
+            distance += quadtree_distance(ctx, t1->children[i], t2->children[i]);
         }
         return distance / 4.0;
     }
 }
 
-QuadtreeNode* draw_quadtree_no_loss(MLV_Image *image) {
-    MaxHeap* heap = create_max_heap(DEFAULT_HEAP_CAPACITY);
-    QuadtreeNode *quadtree = build_quadtree(image, 0, 0, DEFAULT_IMAGE_SIZE, heap);
-    subdivide_and_draw(image, heap);
-    free(heap->nodes);
-    free(heap);
+/* Builds the lossless tree, largest error first. ctx->on_subdivide, when
+ * set, is called after every split so a UI can follow the progression */
+QuadtreeNode* encode_quadtree(QuadtreeContext *ctx, const PixelBuffer *image) {
+    if (!validate_pixel_buffer(image)) return NULL;
+    PixelBuffer *owned;
+    image = ingest_pixel_buffer(ctx, image, &owned);
+    if (!image) return NULL;
+
+    QuadtreeNode *quadtree = NULL;
+    MaxHeap* heap = create_max_heap(ctx, DEFAULT_HEAP_CAPACITY);
+    if (heap) {
+        quadtree = build_quadtree(ctx, image, 0, 0, image->width, heap);
+        if (quadtree && !subdivide_quadtree(ctx, image, heap)) {
+            free_quadtree(ctx, quadtree);
+            quadtree = NULL;
+        }
+        free_max_heap(ctx, heap);
+    }
+    free_pixel_buffer(ctx, owned);
     return quadtree;
 }
 
-void draw_quadtree_with_loss(QuadtreeNode* quadtree, MLV_Image *image) {
-    minimize_with_loss(quadtree, image);
-    MLV_clear_window(MLV_COLOR_BLACK); // Clear the window before drawing the minimized quadtree
-    draw_entire_quadtree(quadtree);
-}
-
-void subdivide_and_draw(MLV_Image *image, MaxHeap* heap) {
+/* Returns 0 when a node can't be allocated; the children built so far stay
+ * attached, so freeing the root releases everything */
+int subdivide_quadtree(QuadtreeContext *ctx, const PixelBuffer *image, MaxHeap* heap) {
+    static const int offset_x[4] = {0, 1, 0, 1};
+    static const int offset_y[4] = {0, 0, 1, 1};
     while (heap->size > 0) {
-        QuadtreeNode* node = extract_max(heap);
+        QuadtreeNode* node = extract_max_heap(heap);
         if (node->size <= 1) {
             continue;
         }
 
         int half_size = node->size / 2;
+        for (int i = 0; i < 4; i++) {
+            node->children[i] = build_quadtree(ctx, image, node->x + offset_x[i] * half_size,
+                                               node->y + offset_y[i] * half_size, half_size, heap);
+            if (!node->children[i]) return 0;
+        }
+        STATS_ADD(ctx, subdivisions, 1);
 
-        node->children[0] = build_quadtree(image, node->x, node->y, half_size, heap);
-        node->children[1] = build_quadtree(image, node->x + half_size, node->y, half_size, heap);
-        node->children[2] = build_quadtree(image, node->x, node->y + half_size, half_size, heap);
-        node->children[3] = build_quadtree(image, node->x + half_size, node->y + half_size, half_size, heap);
+        if (ctx->on_subdivide) {
+            ctx->on_subdivide(node, ctx->callback_user);
+        }
+    }
+    return 1;
+}
 
-        draw_entire_quadtree(node);
-        printf("Subdivided node at (%d, %d) with size %d\n", node->x, node->y, node->size);
+/* Closes a file written by a saver. A failed write or close removes it, so
+ * a truncated tree is never left behind */
+int quadtree_finish_save(FILE *file, const char *filename) {
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Could not write %s\n", filename);
+        remove(filename);
     }
+    return ok;
 }
 
 void save_quadtree_binary(FILE *file, QuadtreeNode *node) {
@@ -179,12 +306,12 @@ void save_quadtree_binary(FILE *file, QuadtreeNode *node) {
         // Leaf node
         int is_leaf = 1;
         fwrite(&is_leaf, sizeof(int), 1, file);
-        Uint8 r, g, b, a;
-        MLV_convert_color_to_rgba(node->color, &r, &g, &b, &a);
-        fwrite(&r, sizeof(Uint8), 1, file);
-        fwrite(&g, sizeof(Uint8), 1, file);
-        fwrite(&b, sizeof(Uint8), 1, file);
-        fwrite(&a, sizeof(Uint8), 1, file);
+        uint8_t r, g, b, a;
+        color_to_rgba(node->color, &r, &g, &b, &a);
+        fwrite(&r, sizeof(uint8_t), 1, file);
+        fwrite(&g, sizeof(uint8_t), 1, file);
+        fwrite(&b, sizeof(uint8_t), 1, file);
+        fwrite(&a, sizeof(uint8_t), 1, file);
     } else {
         // Internal node
         int is_leaf = 0;
@@ -195,17 +322,17 @@ void save_quadtree_binary(FILE *file, QuadtreeNode *node) {
     }
 }
 
-void save_image_quadtree(const char *filename, QuadtreeNode *quadtree) {
+int save_image_quadtree(QuadtreeContext *ctx, const char *filename, QuadtreeNode *quadtree) {
     FILE *file = fopen(filename, "wb");
     if (!file) {
         fprintf(stderr, "Could not open file for writing: %s\n", filename);
-        return;
+        return 0;
     }
-    save_quadtree_binary(file, quadtree);
-    fclose(file);
+    save_quadtree_parallel(ctx, file, quadtree, SAVE_FORMAT_QTC);
+    return quadtree_finish_save(file, filename);
 }
 
-const char* get_file_extension(const char *filename) {
+const char* quadtree_file_extension(const char *filename) {
     const char *dot = strrchr(filename, '.');
     if(!dot || dot == filename) return "";
     return dot + 1;
@@ -218,10 +345,10 @@ void save_quadtree_binary_bw(FILE *file, QuadtreeNode *node) {
         // Leaf node
         int is_leaf = 1;
         fwrite(&is_leaf, sizeof(int), 1, file);
-        Uint8 r, g, b, a;
-        MLV_convert_color_to_rgba(node->color, &r, &g, &b, &a);
-        Uint8 gray = (r + g + b) / 3;
-        fwrite(&gray, sizeof(Uint8), 1, file);
+        uint8_t r, g, b, a;
+        color_to_rgba(node->color, &r, &g, &b, &a);
+        uint8_t gray = (r + g + b) / 3;
+        fwrite(&gray, sizeof(uint8_t), 1, file);
     } else {
         // Internal node
         int is_leaf = 0;
@@ -232,14 +359,14 @@ void save_quadtree_binary_bw(FILE *file, QuadtreeNode *node) {
     }
 }
 
-void save_image_quadtree_bw(const char *filename, QuadtreeNode *quadtree) {
+int save_image_quadtree_bw(QuadtreeContext *ctx, const char *filename, QuadtreeNode *quadtree) {
     FILE *file = fopen(filename, "wb");
     if (!file) {
         fprintf(stderr, "Could not open file for writing: %s\n", filename);
-        return;
+        return 0;
     }
-    save_quadtree_binary_bw(file, quadtree);
-    fclose(file);
+    save_quadtree_parallel(ctx, file, quadtree, SAVE_FORMAT_QTN);
+    return quadtree_finish_save(file, filename);
 }
 
 // Fonction pour sauvegarder le quadtree en tant que graphe minimisé
@@ -265,127 +392,275 @@ void save_quadtree_as_graph(FILE *file, QuadtreeNode *node) {
     }
 }
 
-void save_image_quadtree_graph(const char *filename, QuadtreeNode *quadtree) {
+int save_image_quadtree_graph(QuadtreeContext *ctx, const char *filename, QuadtreeNode *quadtree) {
     FILE *file = fopen(filename, "w");
     if (!file) {
         fprintf(stderr, "Could not open file for writing: %s\n", filename);
-        return;
+        return 0;
+    }
+    assign_ids_parallel(ctx, quadtree);
+    save_quadtree_parallel(ctx, file, quadtree, SAVE_FORMAT_GRAPH);
+    return quadtree_finish_save(file, filename);
+}
+
+/* Mean of the children colors; children always cover equal areas */
+static Color mean_children_color(QuadtreeNode *node) {
+    int r = 0, g = 0, b = 0, a = 0, count = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!node->children[i]) continue;
+        uint8_t cr, cg, cb, ca;
+        color_to_rgba(node->children[i]->color, &cr, &cg, &cb, &ca);
+        r += cr;
+        g += cg;
+        b += cb;
+        a += ca;
+        count++;
     }
-    int current_id = 0;
-    assign_ids(quadtree, &current_id);
-    save_quadtree_as_graph(file, quadtree);
+    if (count == 0) return node->color;
+    return rgba_color((r + count / 2) / count, (g + count / 2) / count,
+                      (b + count / 2) / count, (a + count / 2) / count);
+}
+
+void derive_internal_colors(QuadtreeNode *node) {
+    if (!node || node->children[0] == NULL) return;
+    for (int i = 0; i < 4; i++) {
+        derive_internal_colors(node->children[i]);
+    }
+    node->color = mean_children_color(node);
+}
+
+static QuadtreeNode* load_quadtree_stream_lod(QuadtreeContext *ctx, FILE *file, int bw, int size, int x, int y, int depth_left);
+
+/* Full-depth loads: NULL if the stream is truncated or corrupt, or if a
+ * node can't be allocated */
+QuadtreeNode* load_quadtree_binary(QuadtreeContext *ctx, FILE *file, int size, int x, int y) {
+    return load_quadtree_stream_lod(ctx, file, 0, size, x, y, INT_MAX);
+}
+
+QuadtreeNode* load_quadtree_binary_bw(QuadtreeContext *ctx, FILE *file, int size, int x, int y) {
+    return load_quadtree_stream_lod(ctx, file, 1, size, x, y, INT_MAX);
+}
+
+QuadtreeNode* load_image_quadtree(QuadtreeContext *ctx, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open file for reading: %s\n", filename);
+        return NULL;
+    }
+    QuadtreeNode *quadtree = load_quadtree_binary(ctx, file, DEFAULT_IMAGE_SIZE, 0, 0);
     fclose(file);
+    return quadtree;
 }
 
-QuadtreeNode* load_quadtree_binary(FILE *file, int size, int x, int y) {
-    int is_leaf;
-    if (fread(&is_leaf, sizeof(int), 1, file) != 1) {
+QuadtreeNode* load_image_quadtree_bw(QuadtreeContext *ctx, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open file for reading: %s\n", filename);
         return NULL;
     }
+    QuadtreeNode *quadtree = load_quadtree_binary_bw(ctx, file, DEFAULT_IMAGE_SIZE, 0, 0);
+    fclose(file);
+    return quadtree;
+}
+
+int read_quadtree_leaf_color(FILE *file, int bw, Color *color) {
+    if (bw) {
+        uint8_t gray;
+        if (fread(&gray, sizeof(uint8_t), 1, file) != 1) return 0;
+        *color = rgba_color(gray, gray, gray, 255);
+    } else {
+        uint8_t rgba[4];
+        if (fread(rgba, sizeof(uint8_t), 4, file) != 4) return 0;
+        *color = rgba_color(rgba[0], rgba[1], rgba[2], rgba[3]);
+    }
+    return 1;
+}
+
+/* Consumes a whole subtree of the given size from the stream without
+ * allocating anything, accumulating its colors weighted by the fraction of
+ * area they cover. A pixel that claims children fails, which also bounds
+ * the recursion on corrupt input. */
+int skip_quadtree_stream(FILE *file, int bw, int size, double weight, double sums[4]) {
+    int is_leaf;
+    if (fread(&is_leaf, sizeof(int), 1, file) != 1) return 0;
 
     if (is_leaf) {
-        // Leaf node
-        Uint8 r, g, b, a;
-        fread(&r, sizeof(Uint8), 1, file);
-        fread(&g, sizeof(Uint8), 1, file);
-        fread(&b, sizeof(Uint8), 1, file);
-        fread(&a, sizeof(Uint8), 1, file);
-        MLV_Color color = MLV_rgba(r, g, b, a);
-        return create_quadtree_node(x, y, size, color, 0.0);
-    } else {
-        // Internal node
-        QuadtreeNode *node = create_quadtree_node(x, y, size, MLV_COLOR_BLACK, 0.0);
-        int half_size = size / 2;
-        node->children[0] = load_quadtree_binary(file, half_size, x, y);
-        node->children[1] = load_quadtree_binary(file, half_size, x + half_size, y);
-        node->children[2] = load_quadtree_binary(file, half_size, x, y + half_size);
-        node->children[3] = load_quadtree_binary(file, half_size, x + half_size, y + half_size);
-        return node;
+        Color color;
+        if (!read_quadtree_leaf_color(file, bw, &color)) return 0;
+        uint8_t r, g, b, a;
+        color_to_rgba(color, &r, &g, &b, &a);
+        sums[0] += r * weight;
+        sums[1] += g * weight;
+        sums[2] += b * weight;
+        sums[3] += a * weight;
+        return 1;
+    }
+    if (size <= 1) return 0;
+    for (int i = 0; i < 4; i++) {
+        if (!skip_quadtree_stream(file, bw, size / 2, weight / 4.0, sums)) return 0;
     }
+    return 1;
 }
 
-QuadtreeNode* load_quadtree_binary_bw(FILE *file, int size, int x, int y) {
+static QuadtreeNode* load_quadtree_stream_lod(QuadtreeContext *ctx, FILE *file, int bw, int size, int x, int y, int depth_left) {
     int is_leaf;
     if (fread(&is_leaf, sizeof(int), 1, file) != 1) {
         return NULL;
     }
 
     if (is_leaf) {
-        // Leaf node
-        Uint8 gray;
-        fread(&gray, sizeof(Uint8), 1, file);
-        MLV_Color color = MLV_rgba(gray, gray, gray, 255);
-        return create_quadtree_node(x, y, size, color, 0.0);
-    } else {
-        // Internal node
-        QuadtreeNode *node = create_quadtree_node(x, y, size, MLV_COLOR_BLACK, 0.0);
-        int half_size = size / 2;
-        node->children[0] = load_quadtree_binary_bw(file, half_size, x, y);
-        node->children[1] = load_quadtree_binary_bw(file, half_size, x + half_size, y);
-        node->children[2] = load_quadtree_binary_bw(file, half_size, x, y + half_size);
-        node->children[3] = load_quadtree_binary_bw(file, half_size, x + half_size, y + half_size);
-        return node;
+        Color color;
+        if (!read_quadtree_leaf_color(file, bw, &color)) return NULL;
+        return create_quadtree_node(ctx, x, y, size, color, 0.0);
     }
+
+    if (size <= 1) {
+        // A pixel cannot be split: corrupt stream
+        return NULL;
+    }
+    int half_size = size / 2;
+    if (depth_left <= 0) {
+        // Deepest level reached: the subtree collapses to its mean color
+        double sums[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int i = 0; i < 4; i++) {
+            if (!skip_quadtree_stream(file, bw, half_size, 0.25, sums)) return NULL;
+        }
+        Color mean = rgba_color((uint8_t)(sums[0] + 0.5), (uint8_t)(sums[1] + 0.5),
+                                (uint8_t)(sums[2] + 0.5), (uint8_t)(sums[3] + 0.5));
+        return create_quadtree_node(ctx, x, y, size, mean, 0.0);
+    }
+
+    QuadtreeNode *node = create_quadtree_node(ctx, x, y, size, COLOR_BLACK, 0.0);
+    if (!node) return NULL;
+    static const int offset_x[4] = {0, 1, 0, 1};
+    static const int offset_y[4] = {0, 0, 1, 1};
+    for (int i = 0; i < 4; i++) {
+        node->children[i] = load_quadtree_stream_lod(ctx, file, bw, half_size, x + offset_x[i] * half_size,
+                                                     y + offset_y[i] * half_size, depth_left - 1);
+        if (!node->children[i]) {
+            // Truncated stream or no memory: report it instead of returning a partial tree
+            free_quadtree(ctx, node);
+            return NULL;
+        }
+    }
+    node->color = mean_children_color(node);
+    return node;
+}
+
+QuadtreeNode* load_quadtree_binary_lod(QuadtreeContext *ctx, FILE *file, int size, int x, int y, int max_depth) {
+    return load_quadtree_stream_lod(ctx, file, 0, size, x, y, max_depth);
+}
+
+QuadtreeNode* load_quadtree_binary_bw_lod(QuadtreeContext *ctx, FILE *file, int size, int x, int y, int max_depth) {
+    return load_quadtree_stream_lod(ctx, file, 1, size, x, y, max_depth);
 }
 
-QuadtreeNode* load_image_quadtree(const char *filename) {
+QuadtreeNode* load_image_quadtree_lod(QuadtreeContext *ctx, const char *filename, int max_depth) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
         fprintf(stderr, "Could not open file for reading: %s\n", filename);
         return NULL;
     }
-    QuadtreeNode *quadtree = load_quadtree_binary(file, DEFAULT_IMAGE_SIZE, 0, 0);
+    QuadtreeNode *quadtree = load_quadtree_binary_lod(ctx, file, DEFAULT_IMAGE_SIZE, 0, 0, max_depth);
     fclose(file);
     return quadtree;
 }
 
-QuadtreeNode* load_image_quadtree_bw(const char *filename) {
+QuadtreeNode* load_image_quadtree_bw_lod(QuadtreeContext *ctx, const char *filename, int max_depth) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
         fprintf(stderr, "Could not open file for reading: %s\n", filename);
         return NULL;
     }
-    QuadtreeNode *quadtree = load_quadtree_binary_bw(file, DEFAULT_IMAGE_SIZE, 0, 0);
+    QuadtreeNode *quadtree = load_quadtree_binary_bw_lod(ctx, file, DEFAULT_IMAGE_SIZE, 0, 0, max_depth);
     fclose(file);
     return quadtree;
 }
 
-QuadtreeNode* load_quadtree_graph(FILE *file) {
+/* Smallest depth whose 2^depth cells per side cover every output pixel */
+int lod_depth_for_resolution(int output_size) {
+    int depth = 0;
+    while ((1 << depth) < output_size && depth < 30) {
+        depth++;
+    }
+    return depth;
+}
+
+/* Nodes are released one by one: the links between them may not form a
+ * tree yet when loading stops */
+static void release_graph_nodes(QuadtreeContext *ctx, QuadtreeNode **nodes, int capacity) {
+    for (int i = 0; i < capacity; i++) {
+        if (nodes[i]) {
+            quadtree_release(ctx, nodes[i]);
+            STATS_ADD(ctx, nodes_freed, 1);
+        }
+    }
+    quadtree_release(ctx, nodes);
+}
+
+QuadtreeNode* load_quadtree_graph(QuadtreeContext *ctx, FILE *file) {
     int id, c0, c1, c2, c3;
     int capacity = GRAPH_NODE_CAPACITY_INITIAL;
-    QuadtreeNode** nodes = (QuadtreeNode**)safe_malloc(capacity * sizeof(QuadtreeNode*));
+    QuadtreeNode** nodes = (QuadtreeNode**)quadtree_alloc(ctx, capacity * sizeof(QuadtreeNode*));
+    if (!nodes) return NULL;
+    memset(nodes, 0, capacity * sizeof(QuadtreeNode*));
     int node_count = 0;
 
     while (fscanf(file, "%d", &id) != EOF) {
-        if (id >= capacity) {
+        if (id < 0) break;
+        while (id >= capacity) {
+            QuadtreeNode **grown = (QuadtreeNode**)quadtree_grow(ctx, nodes, capacity * sizeof(QuadtreeNode*),
+                                                                 capacity * HEAP_GROWTH_FACTOR * sizeof(QuadtreeNode*));
+            if (!grown) {
+                release_graph_nodes(ctx, nodes, capacity);
+                return NULL;
+            }
+            memset(grown + capacity, 0, capacity * (HEAP_GROWTH_FACTOR - 1) * sizeof(QuadtreeNode*));
+            nodes = grown;
             capacity *= HEAP_GROWTH_FACTOR;
-            nodes = (QuadtreeNode**)safe_realloc(nodes, capacity * sizeof(QuadtreeNode*));
         }
         
         char c;
         fscanf(file, "%c", &c);
+        QuadtreeNode *node;
         if (c == 'f') {
             int r, g, b, a;
             fscanf(file, "%d %d %d %d", &r, &g, &b, &a);
-            nodes[id] = create_quadtree_node(0, 0, 0, MLV_rgba(r, g, b, a), 0.0);
+            node = create_quadtree_node(ctx, 0, 0, 0, rgba_color(r, g, b, a), 0.0);
         } else {
             ungetc(c, file);
             fscanf(file, "%d %d %d %d", &c0, &c1, &c2, &c3);
-            nodes[id] = create_quadtree_node(0, 0, 0, MLV_COLOR_BLACK, 0.0);
-            nodes[id]->children[0] = c0 == -1 ? NULL : nodes[c0];
-            nodes[id]->children[1] = c1 == -1 ? NULL : nodes[c1];
-            nodes[id]->children[2] = c2 == -1 ? NULL : nodes[c2];
-            nodes[id]->children[3] = c3 == -1 ? NULL : nodes[c3];
+            node = create_quadtree_node(ctx, 0, 0, 0, COLOR_BLACK, 0.0);
+            if (node) {
+                node->children[0] = c0 < 0 || c0 >= capacity ? NULL : nodes[c0];
+                node->children[1] = c1 < 0 || c1 >= capacity ? NULL : nodes[c1];
+                node->children[2] = c2 < 0 || c2 >= capacity ? NULL : nodes[c2];
+                node->children[3] = c3 < 0 || c3 >= capacity ? NULL : nodes[c3];
+            }
         }
+        if (!node) {
+            release_graph_nodes(ctx, nodes, capacity);
+            return NULL;
+        }
+        nodes[id] = node;
         nodes[id]->id = id;
         node_count++;
     }
 
     QuadtreeNode* root = nodes[0];
-    free(nodes);
+    quadtree_release(ctx, nodes);
     return root;
 }
 
+int count_quadtree_nodes(QuadtreeNode *node) {
+    if (!node) return 0;
+    int count = 1;
+    for (int i = 0; i < 4; i++) {
+        count += count_quadtree_nodes(node->children[i]);
+    }
+    return count;
+}
+
 void assign_ids(QuadtreeNode *node, int *current_id) {
     if (!node) return;
 
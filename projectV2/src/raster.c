@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../include/raster.h"
+#include "../include/quadtree.h"
+#include "../include/config.h"
+#include "../include/ycbcr.h"
+#include "../include/utils.h"
+
+static void fill_rect(unsigned char *pixels, int stride, int x, int y, int size, Color color) {
+    uint8_t r, g, b, a;
+    color_to_rgba(color, &r, &g, &b, &a);
+    for (int j = y; j < y + size; j++) {
+        unsigned char *row = pixels + ((size_t)j * stride + x) * 3;
+        for (int i = 0; i < size; i++) {
+            row[3 * i] = r;
+            row[3 * i + 1] = g;
+            row[3 * i + 2] = b;
+        }
+    }
+}
+
+/* x, y and size are in output pixels, tree_size is the node size in the
+ * tree; a subtree that shrinks to a single pixel is read through and
+ * replaced by its mean color */
+static int stream_node(FILE *file, int bw, unsigned char *pixels, int stride, int x, int y, int size, int tree_size) {
+    int is_leaf;
+    if (fread(&is_leaf, sizeof(int), 1, file) != 1) return 0;
+
+    if (is_leaf) {
+        Color color;
+        if (!read_quadtree_leaf_color(file, bw, &color)) return 0;
+        fill_rect(pixels, stride, x, y, size, color);
+        return 1;
+    }
+    // A pixel of the tree cannot be split: corrupt stream
+    if (tree_size <= 1) return 0;
+
+    if (size <= 1) {
+        double sums[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int i = 0; i < 4; i++) {
+            if (!skip_quadtree_stream(file, bw, tree_size / 2, 0.25, sums)) return 0;
+        }
+        fill_rect(pixels, stride, x, y, 1, rgba_color((uint8_t)(sums[0] + 0.5), (uint8_t)(sums[1] + 0.5),
+                                                    (uint8_t)(sums[2] + 0.5), (uint8_t)(sums[3] + 0.5)));
+        return 1;
+    }
+
+    int half_size = size / 2;
+    int half_tree = tree_size / 2;
+    return stream_node(file, bw, pixels, stride, x, y, half_size, half_tree) &&
+           stream_node(file, bw, pixels, stride, x + half_size, y, half_size, half_tree) &&
+           stream_node(file, bw, pixels, stride, x, y + half_size, half_size, half_tree) &&
+           stream_node(file, bw, pixels, stride, x + half_size, y + half_size, half_size, half_tree);
+}
+
+/* The three YCbCr trees are interleaved in the file, so they are loaded and
+ * recombined at their native size */
+static int decode_ycbcr_to_ppm(QuadtreeContext *ctx, const char *input, const char *output, int output_size) {
+    YCbCrQuadtree *quadtree = load_image_quadtree_ycbcr(ctx, input);
+    if (!quadtree) return 0;
+    if (output_size != quadtree->luma_size) {
+        fprintf(stderr, "YCbCr files decode at their native size: %d\n", quadtree->luma_size);
+        free_ycbcr_quadtree(ctx, quadtree);
+        return 0;
+    }
+
+    size_t length = (size_t)output_size * output_size * 3;
+    uint8_t *rgb = (uint8_t*)quadtree_alloc(ctx, length);
+    if (!rgb || !rasterize_ycbcr_quadtree(ctx, quadtree, rgb)) {
+        fprintf(stderr, "Not enough memory to decode %s\n", input);
+        quadtree_release(ctx, rgb);
+        free_ycbcr_quadtree(ctx, quadtree);
+        return 0;
+    }
+
+    FILE *file = fopen(output, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open file for writing: %s\n", output);
+        quadtree_release(ctx, rgb);
+        free_ycbcr_quadtree(ctx, quadtree);
+        return 0;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", output_size, output_size);
+    int ok = fwrite(rgb, 1, length, file) == length;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Could not write file: %s\n", output);
+        unlink(output);
+    }
+
+    quadtree_release(ctx, rgb);
+    free_ycbcr_quadtree(ctx, quadtree);
+    return ok;
+}
+
+int decode_quadtree_to_ppm(QuadtreeContext *ctx, const char *input, const char *output, int output_size) {
+    if (output_size <= 0 || (output_size & (output_size - 1)) != 0) {
+        fprintf(stderr, "Output size must be a power of two: %d\n", output_size);
+        return 0;
+    }
+    if (strcmp(quadtree_file_extension(input), "qty") == 0) {
+        return decode_ycbcr_to_ppm(ctx, input, output, output_size);
+    }
+
+    FILE *file = fopen(input, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open file for reading: %s\n", input);
+        return 0;
+    }
+    int bw = strcmp(quadtree_file_extension(input), "qtn") == 0;
+
+    int fd = open(output, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open file for writing: %s\n", output);
+        fclose(file);
+        return 0;
+    }
+
+    /* Leaves arrive in quadrant order, not row order: the output file itself
+     * is mapped and written in place instead of buffering the image */
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", output_size, output_size);
+    size_t length = header_length + (size_t)output_size * output_size * 3;
+
+    if (ftruncate(fd, length) != 0) {
+        fprintf(stderr, "Could not resize file: %s\n", output);
+        close(fd);
+        unlink(output);
+        fclose(file);
+        return 0;
+    }
+    unsigned char *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Could not map file: %s\n", output);
+        close(fd);
+        unlink(output);
+        fclose(file);
+        return 0;
+    }
+
+    memcpy(map, header, header_length);
+    int ok = stream_node(file, bw, map + header_length, output_size, 0, 0, output_size, DEFAULT_IMAGE_SIZE);
+    if (!ok) {
+        fprintf(stderr, "Truncated quadtree stream: %s\n", input);
+    }
+
+    munmap(map, length);
+    close(fd);
+    fclose(file);
+    if (!ok) {
+        // Never leave a partly decoded image behind
+        unlink(output);
+    }
+    return ok;
+}
@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/safe_alloc.h"
+
+/* Safe memory allocation functions */
+void* safe_malloc(size_t size) {
+    void* ptr = malloc(size);
+    if (ptr == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed (malloc %zu bytes)\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void* safe_realloc(void* ptr, size_t size) {
+    void* new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL) {
+        fprintf(stderr, "Error: Memory reallocation failed (realloc %zu bytes)\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return new_ptr;
+}
@@ -2,6 +2,9 @@
 #include <MLV/MLV_all.h>
 #include "../include/view.h"
 #include "../include/config.h"
+#include "../include/utils.h"
+#include "../include/parallel.h"
+#include "../include/safe_alloc.h"
 
 void draw_quadtree(QuadtreeNode *node) {
     if (!node) return;
@@ -16,6 +19,80 @@ void draw_entire_quadtree(QuadtreeNode *node) {
     MLV_actualise_window();
 }
 
+/* Draws the tree scaled to an output_size square at (ox, oy). Recursion stops
+ * as soon as a node covers one output pixel, so the cost follows the output
+ * resolution rather than the tree size. Both edges of a node are scaled, so
+ * neighbours share them and no row or column is left unpainted when
+ * output_size is not a power of two. Internal node colors must be set
+ * (see derive_internal_colors). */
+void draw_quadtree_scaled(QuadtreeNode *node, int ox, int oy, int output_size) {
+    if (!node) return;
+    int x = node->x * output_size / DEFAULT_IMAGE_SIZE;
+    int y = node->y * output_size / DEFAULT_IMAGE_SIZE;
+    int width = (node->x + node->size) * output_size / DEFAULT_IMAGE_SIZE - x;
+    int height = (node->y + node->size) * output_size / DEFAULT_IMAGE_SIZE - y;
+
+    if (node->children[0] == NULL || (width <= 1 && height <= 1)) {
+        MLV_draw_filled_rectangle(ox + x, oy + y, width > 1 ? width : 1, height > 1 ? height : 1, node->color);
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        draw_quadtree_scaled(node->children[i], ox, oy, output_size);
+    }
+}
+
+void draw_quadtree_thumbnail(QuadtreeNode *node, int ox, int oy, int output_size) {
+    draw_quadtree_scaled(node, ox, oy, output_size);
+    MLV_actualise_window();
+}
+
+void draw_ycbcr_quadtree(QuadtreeContext *ctx, YCbCrQuadtree *quadtree) {
+    int size = quadtree->luma_size;
+    uint8_t *rgb = (uint8_t*)safe_malloc((size_t)size * size * 3);
+    if (!rasterize_ycbcr_quadtree(ctx, quadtree, rgb)) {
+        printf("Not enough memory to draw the YCbCr quadtree\n");
+        free(rgb);
+        return;
+    }
+
+    MLV_Image *image = MLV_create_image(size, size);
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            uint8_t *pixel = rgb + ((size_t)j * size + i) * 3;
+            MLV_set_pixel_on_image(i, j, MLV_rgba(pixel[0], pixel[1], pixel[2], 255), image);
+        }
+    }
+    MLV_draw_image(image, 0, 0);
+    MLV_actualise_window();
+
+    MLV_free_image(image);
+    free(rgb);
+}
+
+static void draw_subdivision(QuadtreeNode *node, void *user) {
+    (void)user;
+    draw_entire_quadtree(node);
+    printf("Subdivided node at (%d, %d) with size %d\n", node->x, node->y, node->size);
+}
+
+/* Builds the lossless tree, redrawing the window after each split */
+QuadtreeNode* draw_quadtree_no_loss(QuadtreeContext *ctx, const PixelBuffer *image) {
+    void (*on_subdivide)(QuadtreeNode*, void*) = ctx->on_subdivide;
+    ctx->on_subdivide = draw_subdivision;
+    QuadtreeNode *quadtree = encode_quadtree(ctx, image);
+    ctx->on_subdivide = on_subdivide;
+    return quadtree;
+}
+
+void draw_quadtree_with_loss(QuadtreeContext *ctx, QuadtreeNode *quadtree, const PixelBuffer *image) {
+    if (!minimize_with_loss_parallel(ctx, quadtree, image)) {
+        printf("Could not minimize the quadtree\n");
+        return;
+    }
+    MLV_clear_window(MLV_COLOR_BLACK); // Clear the window before drawing the minimized quadtree
+    draw_entire_quadtree(quadtree);
+}
+
 void draw_buttons() {
     int button_width = BUTTON_WIDTH;
     int button_height = BUTTON_HEIGHT;
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/ycbcr.h"
+#include "../include/quadtree.h"
+#include "../include/config.h"
+#include "../include/utils.h"
+
+#define YCBCR_MAGIC "QTY1"
+
+static uint8_t clamp_channel(double value) {
+    if (value < 0.0) return 0;
+    if (value > 255.0) return 255;
+    return (uint8_t)(value + 0.5);
+}
+
+/* Splits until the mean squared error of the block drops under threshold.
+ * The plane is in Morton order, so each block is one contiguous run. */
+QuadtreeNode* build_plane_quadtree(QuadtreeContext *ctx, const uint8_t *plane, int x, int y, int size, double threshold) {
+    const uint8_t *block = plane + morton_index(x, y);
+    int count = size * size;
+    uint64_t sum = 0;
+    for (int k = 0; k < count; k++) {
+        sum += block[k];
+    }
+    int mean = (int)((sum + count / 2) / count);
+
+    double error = 0.0;
+    for (int k = 0; k < count; k++) {
+        int d = block[k] - mean;
+        error += d * d;
+    }
+
+    QuadtreeNode *node = create_quadtree_node(ctx, x, y, size, rgba_color(mean, mean, mean, 255), error);
+    if (!node || size <= MIN_NODE_SIZE || error <= threshold * count) {
+        return node;
+    }
+
+    int half_size = size / 2;
+    static const int offset_x[4] = {0, 1, 0, 1};
+    static const int offset_y[4] = {0, 0, 1, 1};
+    for (int i = 0; i < 4; i++) {
+        node->children[i] = build_plane_quadtree(ctx, plane, x + offset_x[i] * half_size,
+                                                 y + offset_y[i] * half_size, half_size, threshold);
+        if (!node->children[i]) {
+            free_quadtree(ctx, node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+static YCbCrQuadtree* create_ycbcr_quadtree(QuadtreeContext *ctx, int luma_size, int chroma_size) {
+    YCbCrQuadtree *quadtree = (YCbCrQuadtree*)quadtree_alloc(ctx, sizeof(YCbCrQuadtree));
+    if (!quadtree) return NULL;
+    quadtree->luma_size = luma_size;
+    quadtree->chroma_size = chroma_size;
+    quadtree->luma = quadtree->cb = quadtree->cr = NULL;
+    return quadtree;
+}
+
+/* Planes keep the Morton order of the pixels, and each CHROMA_SUBSAMPLING
+ * square block is a run of block consecutive pixels */
+static void split_planes(const PixelBuffer *image, uint8_t *luma, uint8_t *cb, uint8_t *cr,
+                         double *cb_sum, double *cr_sum) {
+    size_t luma_pixels = (size_t)image->width * image->width;
+    int block = CHROMA_SUBSAMPLING * CHROMA_SUBSAMPLING;
+    size_t chroma_pixels = luma_pixels / block;
+    memset(cb_sum, 0, chroma_pixels * sizeof(double));
+    memset(cr_sum, 0, chroma_pixels * sizeof(double));
+
+    const uint8_t *pixel = image->pixels;
+    for (size_t k = 0; k < luma_pixels; k++, pixel += 4) {
+        int r = pixel[0], g = pixel[1], b = pixel[2];
+        luma[k] = clamp_channel(0.299 * r + 0.587 * g + 0.114 * b);
+
+        size_t c = k / block;
+        cb_sum[c] += 128.0 - 0.168736 * r - 0.331264 * g + 0.5 * b;
+        cr_sum[c] += 128.0 + 0.5 * r - 0.418688 * g - 0.081312 * b;
+    }
+
+    /* Chroma is subsampled by averaging each CHROMA_SUBSAMPLING square block */
+    for (size_t c = 0; c < chroma_pixels; c++) {
+        cb[c] = clamp_channel(cb_sum[c] / block);
+        cr[c] = clamp_channel(cr_sum[c] / block);
+    }
+}
+
+/* NULL if the image is invalid or any allocation fails */
+YCbCrQuadtree* build_ycbcr_quadtree(QuadtreeContext *ctx, const PixelBuffer *image) {
+    if (!validate_pixel_buffer(image)) return NULL;
+    if (image->width < CHROMA_SUBSAMPLING) {
+        fprintf(stderr, "Error: Image smaller than the chroma subsampling\n");
+        return NULL;
+    }
+    PixelBuffer *owned;
+    image = ingest_pixel_buffer(ctx, image, &owned);
+    if (!image) return NULL;
+
+    int luma_size = image->width;
+    int chroma_size = luma_size / CHROMA_SUBSAMPLING;
+    size_t luma_pixels = (size_t)luma_size * luma_size;
+    size_t chroma_pixels = (size_t)chroma_size * chroma_size;
+    uint8_t *luma = (uint8_t*)quadtree_alloc(ctx, luma_pixels);
+    uint8_t *cb = (uint8_t*)quadtree_alloc(ctx, chroma_pixels);
+    uint8_t *cr = (uint8_t*)quadtree_alloc(ctx, chroma_pixels);
+    double *cb_sum = (double*)quadtree_alloc(ctx, chroma_pixels * sizeof(double));
+    double *cr_sum = (double*)quadtree_alloc(ctx, chroma_pixels * sizeof(double));
+
+    YCbCrQuadtree *quadtree = NULL;
+    if (luma && cb && cr && cb_sum && cr_sum) {
+        split_planes(image, luma, cb, cr, cb_sum, cr_sum);
+        quadtree = create_ycbcr_quadtree(ctx, luma_size, chroma_size);
+    }
+    if (quadtree) {
+        quadtree->luma = build_plane_quadtree(ctx, luma, 0, 0, luma_size, ctx->luma_threshold);
+        quadtree->cb = build_plane_quadtree(ctx, cb, 0, 0, chroma_size, ctx->chroma_threshold);
+        quadtree->cr = build_plane_quadtree(ctx, cr, 0, 0, chroma_size, ctx->chroma_threshold);
+        if (!quadtree->luma || !quadtree->cb || !quadtree->cr) {
+            free_ycbcr_quadtree(ctx, quadtree);
+            quadtree = NULL;
+        }
+    }
+
+    quadtree_release(ctx, luma);
+    quadtree_release(ctx, cb);
+    quadtree_release(ctx, cr);
+    quadtree_release(ctx, cb_sum);
+    quadtree_release(ctx, cr_sum);
+    free_pixel_buffer(ctx, owned);
+    return quadtree;
+}
+
+void free_ycbcr_quadtree(QuadtreeContext *ctx, YCbCrQuadtree *quadtree) {
+    if (!quadtree) return;
+    free_quadtree(ctx, quadtree->luma);
+    free_quadtree(ctx, quadtree->cb);
+    free_quadtree(ctx, quadtree->cr);
+    quadtree_release(ctx, quadtree);
+}
+
+/* Container: magic, luma size, chroma size, then the luma, Cb and Cr trees
+ * one after the other in the QTN encoding */
+int save_image_quadtree_ycbcr(const char *filename, YCbCrQuadtree *quadtree) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open file for writing: %s\n", filename);
+        return 0;
+    }
+    fwrite(YCBCR_MAGIC, 1, 4, file);
+    fwrite(&quadtree->luma_size, sizeof(int), 1, file);
+    fwrite(&quadtree->chroma_size, sizeof(int), 1, file);
+    save_quadtree_binary_bw(file, quadtree->luma);
+    save_quadtree_binary_bw(file, quadtree->cb);
+    save_quadtree_binary_bw(file, quadtree->cr);
+    return quadtree_finish_save(file, filename);
+}
+
+/* Rasterization maps every luma pixel to chroma pixel (j / ratio, i / ratio),
+ * which stays inside the chroma plane only for power-of-two sizes where
+ * chroma divides luma */
+static int valid_ycbcr_sizes(int luma_size, int chroma_size) {
+    if (luma_size <= 0 || chroma_size <= 0) return 0;
+    if (luma_size > YCBCR_MAX_SIZE || chroma_size > luma_size) return 0;
+    if ((luma_size & (luma_size - 1)) != 0 || (chroma_size & (chroma_size - 1)) != 0) return 0;
+    return luma_size % chroma_size == 0;
+}
+
+YCbCrQuadtree* load_image_quadtree_ycbcr(QuadtreeContext *ctx, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open file for reading: %s\n", filename);
+        return NULL;
+    }
+
+    char magic[4];
+    int luma_size, chroma_size;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, YCBCR_MAGIC, 4) != 0 ||
+        fread(&luma_size, sizeof(int), 1, file) != 1 ||
+        fread(&chroma_size, sizeof(int), 1, file) != 1 ||
+        !valid_ycbcr_sizes(luma_size, chroma_size)) {
+        fprintf(stderr, "Not a YCbCr quadtree file: %s\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    YCbCrQuadtree *quadtree = create_ycbcr_quadtree(ctx, luma_size, chroma_size);
+    if (!quadtree) {
+        fclose(file);
+        return NULL;
+    }
+    quadtree->luma = load_quadtree_binary_bw(ctx, file, luma_size, 0, 0);
+    quadtree->cb = load_quadtree_binary_bw(ctx, file, chroma_size, 0, 0);
+    quadtree->cr = load_quadtree_binary_bw(ctx, file, chroma_size, 0, 0);
+    fclose(file);
+
+    if (!quadtree->luma || !quadtree->cb || !quadtree->cr) {
+        fprintf(stderr, "Could not load YCbCr quadtree: %s\n", filename);
+        free_ycbcr_quadtree(ctx, quadtree);
+        return NULL;
+    }
+    return quadtree;
+}
+
+static void fill_plane(QuadtreeNode *node, uint8_t *plane, int stride) {
+    if (!node) return;
+    if (node->children[0] == NULL) {
+        uint8_t value = get_red_component(node->color);
+        for (int j = node->y; j < node->y + node->size; j++) {
+            memset(plane + (size_t)j * stride + node->x, value, node->size);
+        }
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        fill_plane(node->children[i], plane, stride);
+    }
+}
+
+/* Recombines the three planes into luma_size x luma_size packed RGB.
+ * Returns 0 if the planes can't be allocated */
+int rasterize_ycbcr_quadtree(QuadtreeContext *ctx, YCbCrQuadtree *quadtree, uint8_t *rgb) {
+    int luma_size = quadtree->luma_size;
+    int chroma_size = quadtree->chroma_size;
+    int ratio = luma_size / chroma_size;
+
+    uint8_t *luma = (uint8_t*)quadtree_alloc(ctx, (size_t)luma_size * luma_size);
+    uint8_t *cb = (uint8_t*)quadtree_alloc(ctx, (size_t)chroma_size * chroma_size);
+    uint8_t *cr = (uint8_t*)quadtree_alloc(ctx, (size_t)chroma_size * chroma_size);
+    if (!luma || !cb || !cr) {
+        quadtree_release(ctx, luma);
+        quadtree_release(ctx, cb);
+        quadtree_release(ctx, cr);
+        return 0;
+    }
+    fill_plane(quadtree->luma, luma, luma_size);
+    fill_plane(quadtree->cb, cb, chroma_size);
+    fill_plane(quadtree->cr, cr, chroma_size);
+
+    for (int j = 0; j < luma_size; j++) {
+        for (int i = 0; i < luma_size; i++) {
+            size_t c = (size_t)(j / ratio) * chroma_size + i / ratio;
+            double y = luma[(size_t)j * luma_size + i];
+            double db = cb[c] - 128.0;
+            double dr = cr[c] - 128.0;
+            uint8_t *pixel = rgb + ((size_t)j * luma_size + i) * 3;
+            pixel[0] = clamp_channel(y + 1.402 * dr);
+            pixel[1] = clamp_channel(y - 0.344136 * db - 0.714136 * dr);
+            pixel[2] = clamp_channel(y + 1.772 * db);
+        }
+    }
+
+    quadtree_release(ctx, luma);
+    quadtree_release(ctx, cb);
+    quadtree_release(ctx, cr);
+    return 1;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "check.h"
+#include "../include/metric.h"
+
+/* Block-scan benchmark: average color plus error of every aligned block at
+ * every level, over a row-major image walked column by column (the layout
+ * and scan order the kernels used before Morton order) and over the same
+ * image in Morton order. Run with `make bench`. */
+
+#define BENCH_SIZE 4096
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double strided_block(const PixelBuffer *image, int x, int y, int size) {
+    uint64_t r = 0, g = 0, b = 0, a = 0;
+    for (int i = x; i < x + size; i++) {
+        for (int j = y; j < y + size; j++) {
+            const uint8_t *p = pixel_at(image, i, j);
+            r += p[0]; g += p[1]; b += p[2]; a += p[3];
+        }
+    }
+    uint64_t count = (uint64_t)size * size;
+    int ar = (int)(r / count), ag = (int)(g / count), ab = (int)(b / count), aa = (int)(a / count);
+    double error = 0.0;
+    for (int i = x; i < x + size; i++) {
+        for (int j = y; j < y + size; j++) {
+            const uint8_t *p = pixel_at(image, i, j);
+            int dr = p[0] - ar, dg = p[1] - ag, db = p[2] - ab, da = p[3] - aa;
+            error += dr * dr + dg * dg + db * db + da * da;
+        }
+    }
+    return error;
+}
+
+static double scan_levels(QuadtreeContext *ctx, const PixelBuffer *image, int morton) {
+    double total = 0.0;
+    for (int size = BENCH_SIZE; size >= 1; size /= 2) {
+        for (int y = 0; y < BENCH_SIZE; y += size) {
+            for (int x = 0; x < BENCH_SIZE; x += size) {
+                if (morton) {
+                    Color avg = average_color(image, x, y, size);
+                    total += calculate_error(ctx, image, x, y, size, avg);
+                } else {
+                    total += strided_block(image, x, y, size);
+                }
+            }
+        }
+    }
+    return total;
+}
+
+int main(void) {
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+    ctx.metric = METRIC_RGBA_SQUARED;
+
+    PixelBuffer *image = make_test_image(&ctx, BENCH_SIZE, 1);
+    PixelBuffer *morton = morton_pixel_buffer(&ctx, image);
+
+    double start = now();
+    double strided = scan_levels(&ctx, image, 0);
+    double strided_time = now() - start;
+    start = now();
+    double contiguous = scan_levels(&ctx, morton, 1);
+    double morton_time = now() - start;
+
+    printf("%dx%d, %d levels\n", BENCH_SIZE, BENCH_SIZE, __builtin_ctz(BENCH_SIZE) + 1);
+    printf("row-major, column scan: %.2f s\n", strided_time);
+    printf("Morton, contiguous:     %.2f s\n", morton_time);
+    CHECK(strided == contiguous);
+
+    free_pixel_buffer(&ctx, morton);
+    free_pixel_buffer(&ctx, image);
+    return CHECK_DONE();
+}
@@ -0,0 +1,78 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../include/quadtree.h"
+#include "../include/parallel.h"
+
+/* Minimal assertion helpers shared by the regression checks. Each test is
+ * a standalone program that exits non-zero when any CHECK fails. */
+
+static int check_failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                  \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_DONE() (check_failures == 0 ? 0 : 1)
+
+/* Deterministic row-major test image: flat areas, gradients and noise, so
+ * trees have leaves at every depth */
+static inline PixelBuffer* make_test_image(QuadtreeContext *ctx, int size, uint32_t seed) {
+    PixelBuffer *image = create_pixel_buffer(ctx, size, size);
+    uint32_t state = seed * 2654435761u + 1;
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            uint8_t *pixel = image->pixels + ((size_t)j * size + i) * 4;
+            state = state * 1664525u + 1013904223u;
+            if (i < size / 2 && j < size / 2) {
+                pixel[0] = 200; pixel[1] = 40; pixel[2] = 90; pixel[3] = 255;
+            } else if (i >= size / 2 && j < size / 2) {
+                pixel[0] = (uint8_t)(i * 255 / size); pixel[1] = (uint8_t)(j * 255 / size);
+                pixel[2] = 128; pixel[3] = 255;
+            } else {
+                pixel[0] = (uint8_t)(state >> 24); pixel[1] = (uint8_t)(state >> 16);
+                pixel[2] = (uint8_t)(state >> 8); pixel[3] = (uint8_t)(200 + (state & 31));
+            }
+        }
+    }
+    return image;
+}
+
+/* Writes the RGB channels of image as a binary PPM, the format the MLV
+ * stand-in loads */
+static inline void write_ppm(const char *path, const PixelBuffer *image) {
+    FILE *file = fopen(path, "wb");
+    fprintf(file, "P6\n%d %d\n255\n", image->width, image->height);
+    for (int j = 0; j < image->height; j++) {
+        for (int i = 0; i < image->width; i++) {
+            fwrite(pixel_at(image, i, j), 1, 3, file);
+        }
+    }
+    fclose(file);
+}
+
+/* Serializes into a malloc'ed buffer with the serial savers or the
+ * parallel one */
+static inline char* save_to_memory(QuadtreeContext *ctx, QuadtreeNode *root, SaveFormat format, int parallel, size_t *length) {
+    char *data = NULL;
+    FILE *file = open_memstream(&data, length);
+    if (parallel) {
+        save_quadtree_parallel(ctx, file, root, format);
+    } else if (format == SAVE_FORMAT_QTN) {
+        save_quadtree_binary_bw(file, root);
+    } else if (format == SAVE_FORMAT_GRAPH) {
+        save_quadtree_as_graph(file, root);
+    } else {
+        save_quadtree_binary(file, root);
+    }
+    fclose(file);
+    return data;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "../include/bottomup.h"
+#include "../include/ycbcr.h"
+#include "../include/parallel.h"
+#include "../include/raster.h"
+#include "../include/config.h"
+
+/* Allocator that fails once its budget is spent and counts what is live */
+typedef struct {
+    long budget;
+    long live;
+} FailingAllocator;
+
+static void* failing_alloc(void *user, size_t size) {
+    FailingAllocator *allocator = (FailingAllocator*)user;
+    if (__atomic_sub_fetch(&allocator->budget, 1, __ATOMIC_RELAXED) < 0) return NULL;
+    __atomic_add_fetch(&allocator->live, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void failing_release(void *user, void *ptr) {
+    FailingAllocator *allocator = (FailingAllocator*)user;
+    __atomic_sub_fetch(&allocator->live, 1, __ATOMIC_RELAXED);
+    free(ptr);
+}
+
+static void init_failing_context(QuadtreeContext *ctx, FailingAllocator *allocator) {
+    init_quadtree_context(ctx);
+    allocator->budget = LONG_MAX;
+    allocator->live = 0;
+    ctx->allocator.alloc = failing_alloc;
+    ctx->allocator.release = failing_release;
+    ctx->allocator.user = allocator;
+}
+
+typedef enum { BUILD_TOP_DOWN, BUILD_BOTTOM_UP, BUILD_YCBCR } Builder;
+
+/* Every budget either succeeds or returns NULL with nothing left allocated */
+static void check_builder(Builder builder, const PixelBuffer *image) {
+    FailingAllocator allocator;
+    QuadtreeContext ctx;
+    init_failing_context(&ctx, &allocator);
+    int failures = 0;
+    for (long budget = 0; ; budget++) {
+        allocator.budget = budget;
+        void *result;
+        if (builder == BUILD_YCBCR) {
+            result = build_ycbcr_quadtree(&ctx, image);
+        } else if (builder == BUILD_BOTTOM_UP) {
+            result = build_quadtree_bottom_up(&ctx, image);
+        } else {
+            result = encode_quadtree(&ctx, image);
+        }
+        if (result) {
+            if (builder == BUILD_YCBCR) {
+                free_ycbcr_quadtree(&ctx, (YCbCrQuadtree*)result);
+            } else {
+                free_quadtree(&ctx, (QuadtreeNode*)result);
+            }
+            CHECK(allocator.live == 0);
+            break;
+        }
+        failures++;
+        if (allocator.live != 0 || ctx.stats.nodes_created != ctx.stats.nodes_freed) {
+            CHECK(allocator.live == 0 && ctx.stats.nodes_created == ctx.stats.nodes_freed);
+            break;
+        }
+    }
+    CHECK(failures > 0);
+}
+
+int main(void) {
+    QuadtreeContext plain;
+    init_quadtree_context(&plain);
+
+    /* Entry points refuse images that are not power-of-two squares */
+    PixelBuffer *odd = create_pixel_buffer(&plain, 100, 100);
+    PixelBuffer *wide = create_pixel_buffer(&plain, 64, 32);
+    memset(odd->pixels, 0, (size_t)100 * 100 * 4);
+    memset(wide->pixels, 0, (size_t)64 * 32 * 4);
+    PixelBuffer *invalid[] = {odd, wide, NULL};
+    for (int i = 0; i < 3; i++) {
+        CHECK(encode_quadtree(&plain, invalid[i]) == NULL);
+        CHECK(build_quadtree_bottom_up(&plain, invalid[i]) == NULL);
+        CHECK(build_ycbcr_quadtree(&plain, invalid[i]) == NULL);
+    }
+    CHECK(create_pixel_buffer(&plain, 0, 16) == NULL);
+    PixelBuffer *pixel = make_test_image(&plain, 1, 1);
+    CHECK(build_quadtree_bottom_up(&plain, pixel) == NULL);
+    CHECK(build_ycbcr_quadtree(&plain, pixel) == NULL);
+    free_pixel_buffer(&plain, pixel);
+    free_pixel_buffer(&plain, odd);
+    free_pixel_buffer(&plain, wide);
+
+    /* Builders under every allocation budget, from a row-major image so the
+     * Morton copy is exercised too */
+    PixelBuffer *image = make_test_image(&plain, 16, 4);
+    check_builder(BUILD_TOP_DOWN, image);
+    check_builder(BUILD_BOTTOM_UP, image);
+    check_builder(BUILD_YCBCR, image);
+
+    /* Loading a stream */
+    char dir[] = "/tmp/qt_allocXXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    char qtc[MAX_FILENAME_LENGTH], qty[MAX_FILENAME_LENGTH], ppm[MAX_FILENAME_LENGTH];
+    snprintf(qtc, sizeof(qtc), "%s/tree.qtc", dir);
+    snprintf(qty, sizeof(qty), "%s/tree.qty", dir);
+    snprintf(ppm, sizeof(ppm), "%s/out.ppm", dir);
+    QuadtreeNode *quadtree = encode_quadtree(&plain, image);
+    save_image_quadtree(&plain, qtc, quadtree);
+    free_quadtree(&plain, quadtree);
+    YCbCrQuadtree *ycbcr = build_ycbcr_quadtree(&plain, image);
+    save_image_quadtree_ycbcr(qty, ycbcr);
+    free_ycbcr_quadtree(&plain, ycbcr);
+
+    FailingAllocator allocator;
+    QuadtreeContext ctx;
+    init_failing_context(&ctx, &allocator);
+    for (long budget = 0; ; budget++) {
+        allocator.budget = budget;
+        FILE *file = fopen(qtc, "rb");
+        quadtree = load_quadtree_binary(&ctx, file, 16, 0, 0);
+        fclose(file);
+        if (quadtree) {
+            free_quadtree(&ctx, quadtree);
+            break;
+        }
+        if (allocator.live != 0) break;
+    }
+    CHECK(allocator.live == 0);
+
+    /* YCbCr decoding fails cleanly and leaves no output */
+    for (long budget = 0; ; budget++) {
+        allocator.budget = budget;
+        remove(ppm);
+        if (decode_quadtree_to_ppm(&ctx, qty, ppm, 16)) break;
+        CHECK(access(ppm, F_OK) != 0);
+        if (allocator.live != 0) break;
+    }
+    CHECK(allocator.live == 0);
+
+    /* Parallel passes degrade to the serial ones: same bytes, same ids,
+     * same minimized tree whatever the budget */
+    PixelBuffer *large = make_test_image(&plain, 64, 8);
+    allocator.budget = LONG_MAX;
+    quadtree = encode_quadtree(&ctx, large);
+    QuadtreeNode *reference = encode_quadtree(&ctx, large);
+    long live = allocator.live;
+    size_t expected_length;
+    char *expected = save_to_memory(&plain, quadtree, SAVE_FORMAT_QTC, 1, &expected_length);
+    int expected_ids = 0;
+    assign_ids(reference, &expected_ids);
+    for (long budget = 0; budget < 8; budget++) {
+        allocator.budget = budget;
+        size_t length;
+        char *data = save_to_memory(&ctx, quadtree, SAVE_FORMAT_QTC, 1, &length);
+        CHECK(length == expected_length && memcmp(data, expected, length) == 0);
+        free(data);
+        assign_ids_parallel(&ctx, quadtree);
+        CHECK(quadtree->children[3]->id == reference->children[3]->id);
+        CHECK(allocator.live == live);
+    }
+    free(expected);
+
+    ctx.merge_threshold = 40.0;
+    allocator.budget = 0;
+    CHECK(!minimize_with_loss_parallel(&ctx, quadtree, large));
+    allocator.budget = LONG_MAX;
+    CHECK(minimize_with_loss(&ctx, reference, large));
+    expected = save_to_memory(&plain, reference, SAVE_FORMAT_QTC, 1, &expected_length);
+    allocator.budget = 2;
+    CHECK(minimize_with_loss_parallel(&ctx, quadtree, large));
+    size_t length;
+    char *data = save_to_memory(&plain, quadtree, SAVE_FORMAT_QTC, 1, &length);
+    CHECK(length == expected_length && memcmp(data, expected, length) == 0);
+    free(data);
+    free(expected);
+    free_quadtree(&ctx, quadtree);
+    free_quadtree(&ctx, reference);
+    CHECK(allocator.live == 0);
+    CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+
+    free_pixel_buffer(&plain, large);
+    free_pixel_buffer(&plain, image);
+    remove(qtc);
+    remove(qty);
+    remove(ppm);
+    rmdir(dir);
+    return CHECK_DONE();
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "../include/bottomup.h"
+#include "../include/metric.h"
+#include "../include/config.h"
+
+/* Paints the leaves into a row-major RGBA raster */
+static void paint(QuadtreeNode *node, uint8_t *pixels, int stride) {
+    if (!node) return;
+    if (node->children[0] == NULL) {
+        for (int j = node->y; j < node->y + node->size; j++) {
+            for (int i = node->x; i < node->x + node->size; i++) {
+                uint8_t *pixel = pixels + ((size_t)j * stride + i) * 4;
+                pixel[0] = get_red_component(node->color);
+                pixel[1] = get_green_component(node->color);
+                pixel[2] = get_blue_component(node->color);
+                pixel[3] = get_alpha_component(node->color);
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < 4; i++) paint(node->children[i], pixels, stride);
+}
+
+/* The top-down encoder splits down to pixels; folding groups of four
+ * identical leaves gives the smallest lossless tree */
+static void fold_flat_leaves(QuadtreeContext *ctx, QuadtreeNode *node) {
+    if (!node || node->children[0] == NULL) return;
+    int flat = 1;
+    for (int i = 0; i < 4; i++) {
+        fold_flat_leaves(ctx, node->children[i]);
+        if (node->children[i]->children[0] != NULL || node->children[i]->color != node->children[0]->color) flat = 0;
+    }
+    if (!flat) return;
+    node->color = node->children[0]->color;
+    for (int i = 0; i < 4; i++) {
+        free_quadtree(ctx, node->children[i]);
+        node->children[i] = NULL;
+    }
+}
+
+static int same_shape(QuadtreeNode *a, QuadtreeNode *b) {
+    if (a->x != b->x || a->y != b->y || a->size != b->size) return 0;
+    if ((a->children[0] == NULL) != (b->children[0] == NULL)) return 0;
+    if (a->children[0] == NULL) return a->color == b->color;
+    for (int i = 0; i < 4; i++) {
+        if (!same_shape(a->children[i], b->children[i])) return 0;
+    }
+    return 1;
+}
+
+/* Every leaf is within threshold of the block it covers */
+static int leaves_within(QuadtreeContext *ctx, QuadtreeNode *node, const PixelBuffer *image, double threshold) {
+    if (!node) return 0;
+    if (node->children[0] == NULL) {
+        double error = calculate_error(ctx, image, node->x, node->y, node->size, node->color);
+        return error <= threshold * node->size * node->size + 1e-6;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (!leaves_within(ctx, node->children[i], image, threshold)) return 0;
+    }
+    return 1;
+}
+
+/* Every node, collapsed blocks included, has the color the top-down
+ * encoder gives the same block */
+static int colors_match_encoder(QuadtreeNode *node, const PixelBuffer *image) {
+    if (!node) return 1;
+    if (node->color != average_color(image, node->x, node->y, node->size)) return 0;
+    for (int i = 0; i < 4; i++) {
+        if (!colors_match_encoder(node->children[i], image)) return 0;
+    }
+    return 1;
+}
+
+int main(void) {
+    int size = 64;
+    QuadtreeContext buffers;
+    init_quadtree_context(&buffers);
+    PixelBuffer *image = make_test_image(&buffers, size, 9);
+    PixelBuffer *morton = morton_pixel_buffer(&buffers, image);
+    uint8_t *expected = (uint8_t*)malloc((size_t)size * size * 4);
+    uint8_t *actual = (uint8_t*)malloc((size_t)size * size * 4);
+
+    /* Lossless: both builders reproduce the source and agree on the tree.
+     * The luma metric is left out since it ignores chroma differences */
+    ErrorMetric lossless[] = {METRIC_RGBA_SQUARED, METRIC_WEIGHTED, METRIC_MAX_ABS, METRIC_YCBCR};
+    for (size_t m = 0; m < sizeof(lossless) / sizeof(lossless[0]); m++) {
+        QuadtreeContext ctx;
+        init_quadtree_context(&ctx);
+        ctx.metric = lossless[m];
+        ctx.threshold = 0.0;
+
+        QuadtreeNode *top_down = encode_quadtree(&ctx, image);
+        QuadtreeNode *bottom_up = build_quadtree_bottom_up(&ctx, image);
+        CHECK(top_down && bottom_up);
+        if (!top_down || !bottom_up) continue;
+
+        paint(bottom_up, actual, size);
+        CHECK(memcmp(actual, image->pixels, (size_t)size * size * 4) == 0);
+        paint(top_down, expected, size);
+        CHECK(memcmp(actual, expected, (size_t)size * size * 4) == 0);
+        fold_flat_leaves(&ctx, top_down);
+        CHECK(same_shape(top_down, bottom_up));
+        CHECK(colors_match_encoder(bottom_up, morton));
+
+        free_quadtree(&ctx, top_down);
+        free_quadtree(&ctx, bottom_up);
+        CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+    }
+
+    /* Lossy: every metric keeps each leaf under the threshold, and a looser
+     * threshold never gives a bigger tree */
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        QuadtreeContext ctx;
+        init_quadtree_context(&ctx);
+        ctx.metric = (ErrorMetric)m;
+        int previous = -1;
+        double thresholds[] = {1.0, 16.0, 256.0};
+        for (int t = 0; t < 3; t++) {
+            ctx.threshold = thresholds[t];
+            QuadtreeNode *bottom_up = build_quadtree_bottom_up(&ctx, image);
+            CHECK(bottom_up != NULL);
+            if (!bottom_up) continue;
+            CHECK(leaves_within(&ctx, bottom_up, morton, ctx.threshold));
+            CHECK(colors_match_encoder(bottom_up, morton));
+            int nodes = count_quadtree_nodes(bottom_up);
+            CHECK(previous < 0 || nodes <= previous);
+            previous = nodes;
+            free_quadtree(&ctx, bottom_up);
+        }
+        CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+    }
+
+    free(expected);
+    free(actual);
+    free_pixel_buffer(&buffers, morton);
+    free_pixel_buffer(&buffers, image);
+    return CHECK_DONE();
+}
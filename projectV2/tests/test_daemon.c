@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "check.h"
+#include "../include/daemon.h"
+#include "../include/config.h"
+
+static int connect_daemon(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+/* Sends one request line and returns the reply without its newline */
+static void ask(const char *socket_path, const char *request, char *reply, size_t size) {
+    reply[0] = '\0';
+    int fd = connect_daemon(socket_path);
+    if (fd < 0) return;
+    struct timeval timeout = {3 * DAEMON_READ_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (write(fd, request, strlen(request)) < 0 || write(fd, "\n", 1) < 0) {
+        close(fd);
+        return;
+    }
+    size_t used = 0;
+    ssize_t received;
+    while (used + 1 < size && (received = read(fd, reply + used, 1)) == 1 && reply[used] != '\n') used++;
+    reply[used] = '\0';
+    close(fd);
+}
+
+static int same_content(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    int same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa), cb = fgetc(fb);
+        if (ca != cb) same = 0;
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+static int count_snapshots(const char *cache) {
+    DIR *dir = opendir(cache);
+    int count = 0;
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "input.", 6) == 0) count++;
+    }
+    if (dir) closedir(dir);
+    return count;
+}
+
+int main(void) {
+    char dir[] = "/tmp/qt_daemonXXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    char sock[MAX_FILENAME_LENGTH], cache[MAX_FILENAME_LENGTH], input[MAX_FILENAME_LENGTH];
+    char first[MAX_FILENAME_LENGTH], second[MAX_FILENAME_LENGTH], request[DAEMON_REQUEST_LENGTH];
+    char reply[DAEMON_REQUEST_LENGTH];
+    snprintf(sock, sizeof(sock), "%s/daemon.sock", dir);
+    snprintf(cache, sizeof(cache), "%s/cache", dir);
+    snprintf(input, sizeof(input), "%s/input.ppm", dir);
+    snprintf(first, sizeof(first), "%s/first.qtc", dir);
+    snprintf(second, sizeof(second), "%s/second.qtc", dir);
+    mkdir(cache, 0700);
+
+    QuadtreeContext buffers;
+    init_quadtree_context(&buffers);
+    PixelBuffer *image = make_test_image(&buffers, DEFAULT_IMAGE_SIZE, 11);
+    write_ppm(input, image);
+    free_pixel_buffer(&buffers, image);
+
+    pid_t child = fork();
+    if (child == 0) {
+        QuadtreeContext ctx;
+        init_quadtree_context(&ctx);
+        fclose(stdout);
+        _exit(run_encode_daemon(&ctx, sock, cache, 2) ? 0 : 1);
+    }
+    int fd = -1;
+    for (int attempt = 0; attempt < 200 && fd < 0; attempt++) {
+        if ((fd = connect_daemon(sock)) < 0) usleep(10000);
+    }
+    CHECK(fd >= 0);
+    if (fd >= 0) close(fd);
+
+    /* Only the owner can reach the socket */
+    struct stat info;
+    CHECK(stat(sock, &info) == 0 && (info.st_mode & 0777) == 0600);
+
+    /* A resubmitted asset is served from the cache with the same bytes */
+    snprintf(request, sizeof(request), "ENCODE %s %s", input, first);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strcmp(reply, "OK encoded") == 0);
+    snprintf(request, sizeof(request), "ENCODE %s %s", input, second);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strcmp(reply, "OK cached") == 0);
+    CHECK(same_content(first, second));
+
+    /* New content misses the cache */
+    image = make_test_image(&buffers, DEFAULT_IMAGE_SIZE, 12);
+    write_ppm(input, image);
+    free_pixel_buffer(&buffers, image);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strcmp(reply, "OK encoded") == 0);
+    CHECK(!same_content(first, second));
+    CHECK(count_snapshots(cache) == 0);
+
+    /* Relative paths and missing inputs are refused */
+    ask(sock, "ENCODE input.ppm out.qtc", reply, sizeof(reply));
+    CHECK(strcmp(reply, "ERR paths must be absolute") == 0);
+    snprintf(request, sizeof(request), "ENCODE %s/missing.ppm %s", dir, first);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strncmp(reply, "ERR", 3) == 0);
+    ask(sock, "HELLO", reply, sizeof(reply));
+    CHECK(strncmp(reply, "ERR", 3) == 0);
+
+    /* Paths that don't fit are refused, not truncated */
+    char long_path[MAX_FILENAME_LENGTH + 64];
+    memset(long_path, 'a', sizeof(long_path) - 1);
+    long_path[0] = '/';
+    long_path[sizeof(long_path) - 1] = '\0';
+    snprintf(request, sizeof(request), "ENCODE %s %s", input, long_path);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strcmp(reply, "ERR path too long") == 0);
+
+    /* A failed write is an error and is not cached */
+    char blocked[MAX_FILENAME_LENGTH];
+    snprintf(blocked, sizeof(blocked), "%s/blocked.qtc", dir);
+    mkdir(blocked, 0700);
+    image = make_test_image(&buffers, DEFAULT_IMAGE_SIZE, 13);
+    write_ppm(input, image);
+    free_pixel_buffer(&buffers, image);
+    snprintf(request, sizeof(request), "ENCODE %s %s", input, blocked);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strncmp(reply, "ERR", 3) == 0);
+    snprintf(request, sizeof(request), "ENCODE %s %s", input, first);
+    ask(sock, request, reply, sizeof(reply));
+    CHECK(strcmp(reply, "OK encoded") == 0);
+    rmdir(blocked);
+
+    /* Idle clients on every worker time out instead of starving others */
+    int idle[2];
+    for (int i = 0; i < 2; i++) idle[i] = connect_daemon(sock);
+    ask(sock, "ENCODE input.ppm out.qtc", reply, sizeof(reply));
+    CHECK(strcmp(reply, "ERR paths must be absolute") == 0);
+    for (int i = 0; i < 2; i++) {
+        if (idle[i] >= 0) close(idle[i]);
+    }
+
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+
+    /* Client-side resolution, including outputs that don't exist yet */
+    char resolved[MAX_FILENAME_LENGTH], cwd[MAX_FILENAME_LENGTH], expected[2 * MAX_FILENAME_LENGTH];
+    CHECK(getcwd(cwd, sizeof(cwd)) != NULL);
+    CHECK(absolute_path("tests", resolved, sizeof(resolved)));
+    snprintf(expected, sizeof(expected), "%s/tests", cwd);
+    CHECK(strcmp(resolved, expected) == 0);
+    CHECK(absolute_path("tests/../tests/new.qtc", resolved, sizeof(resolved)));
+    snprintf(expected, sizeof(expected), "%s/tests/new.qtc", cwd);
+    CHECK(strcmp(resolved, expected) == 0);
+    CHECK(!absolute_path("no/such/dir/new.qtc", resolved, sizeof(resolved)));
+
+    remove(input);
+    remove(first);
+    remove(second);
+    remove(sock);
+    DIR *entries = opendir(cache);
+    struct dirent *entry;
+    while (entries && (entry = readdir(entries)) != NULL) {
+        char path[2 * MAX_FILENAME_LENGTH];
+        snprintf(path, sizeof(path), "%s/%s", cache, entry->d_name);
+        if (entry->d_name[0] != '.') remove(path);
+    }
+    if (entries) closedir(entries);
+    rmdir(cache);
+    rmdir(dir);
+    return CHECK_DONE();
+}
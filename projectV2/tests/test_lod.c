@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "../include/config.h"
+
+static void write_leaf(FILE *file, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    int is_leaf = 1;
+    uint8_t rgba[4] = {r, g, b, a};
+    fwrite(&is_leaf, sizeof(int), 1, file);
+    fwrite(rgba, 1, 4, file);
+}
+
+static void write_internal(FILE *file) {
+    int is_leaf = 0;
+    fwrite(&is_leaf, sizeof(int), 1, file);
+}
+
+/* Root with leaves 0..2 and an internal child 3 holding four leaves */
+static FILE* sample_stream(long *length) {
+    FILE *file = tmpfile();
+    write_internal(file);
+    write_leaf(file, 0, 0, 0, 255);
+    write_leaf(file, 100, 0, 0, 255);
+    write_leaf(file, 0, 100, 0, 255);
+    write_internal(file);
+    write_leaf(file, 0, 0, 40, 255);
+    write_leaf(file, 0, 0, 80, 255);
+    write_leaf(file, 0, 0, 120, 255);
+    write_leaf(file, 0, 0, 160, 255);
+    *length = ftell(file);
+    rewind(file);
+    return file;
+}
+
+static void check_color(Color color, int r, int g, int b, int a) {
+    uint8_t cr, cg, cb, ca;
+    color_to_rgba(color, &cr, &cg, &cb, &ca);
+    CHECK(cr == r && cg == g && cb == b && ca == a);
+}
+
+/* Same shape, geometry and colors, internal nodes included */
+static int same_tree(const QuadtreeNode *a, const QuadtreeNode *b) {
+    if (!a || !b) return a == b;
+    if (a->x != b->x || a->y != b->y || a->size != b->size || a->color != b->color) return 0;
+    for (int i = 0; i < 4; i++) {
+        if (!same_tree(a->children[i], b->children[i])) return 0;
+    }
+    return 1;
+}
+
+int main(void) {
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+    long length;
+
+    /* Depth 0: the whole tree collapses to its area-weighted mean */
+    FILE *file = sample_stream(&length);
+    QuadtreeNode *root = load_quadtree_binary_lod(&ctx, file, 8, 0, 0, 0);
+    CHECK(root && root->children[0] == NULL);
+    if (root) check_color(root->color, 25, 25, 25, 255);
+    CHECK(ftell(file) == length);
+    free_quadtree(&ctx, root);
+    fclose(file);
+
+    /* Depth 1: child 3 collapses, the others are read as leaves */
+    file = sample_stream(&length);
+    root = load_quadtree_binary_lod(&ctx, file, 8, 0, 0, 1);
+    CHECK(root && root->children[3] && root->children[3]->children[0] == NULL);
+    if (root && root->children[3]) {
+        check_color(root->children[3]->color, 0, 0, 100, 255);
+        CHECK(root->children[3]->x == 4 && root->children[3]->y == 4 && root->children[3]->size == 4);
+    }
+    free_quadtree(&ctx, root);
+    fclose(file);
+
+    /* Full depth matches the plain loader */
+    file = sample_stream(&length);
+    root = load_quadtree_binary_lod(&ctx, file, 8, 0, 0, 8);
+    fclose(file);
+    file = sample_stream(&length);
+    QuadtreeNode *plain = load_quadtree_binary(&ctx, file, 8, 0, 0);
+    fclose(file);
+    CHECK(root && plain && same_tree(root, plain));
+    CHECK(count_quadtree_nodes(root) == 9);
+    free_quadtree(&ctx, root);
+    free_quadtree(&ctx, plain);
+
+    /* A stream of internal nodes only fails at every depth instead of
+     * recursing without bound */
+    char zeros_path[] = "/tmp/qt_lod_zerosXXXXXX";
+    int fd = mkstemp(zeros_path);
+    CHECK(fd >= 0);
+    FILE *zeros = fdopen(fd, "wb");
+    char *block = (char*)calloc(1, 1 << 20);
+    for (int i = 0; i < 8; i++) fwrite(block, 1, 1 << 20, zeros);
+    free(block);
+    fclose(zeros);
+    for (int depth = 0; depth <= 12; depth += 2) {
+        CHECK(load_image_quadtree_lod(&ctx, zeros_path, depth) == NULL);
+    }
+    remove(zeros_path);
+
+    /* The depth covers every output pixel, rounding up */
+    CHECK(lod_depth_for_resolution(1) == 0);
+    CHECK(lod_depth_for_resolution(64) == 6);
+    CHECK(lod_depth_for_resolution(100) == 7);
+    CHECK(lod_depth_for_resolution(DEFAULT_IMAGE_SIZE) == 9);
+
+    /* Truncated streams fail at every depth instead of yielding a tree */
+    for (int depth = 0; depth <= 2; depth++) {
+        for (long cut = 1; cut < length; cut += 3) {
+            FILE *full = sample_stream(&length);
+            char buffer[256];
+            size_t read = fread(buffer, 1, cut, full);
+            fclose(full);
+            FILE *truncated = tmpfile();
+            fwrite(buffer, 1, read, truncated);
+            rewind(truncated);
+            root = load_quadtree_binary_lod(&ctx, truncated, 8, 0, 0, depth);
+            CHECK(root == NULL);
+            free_quadtree(&ctx, root);
+            fclose(truncated);
+        }
+    }
+
+    CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+    return CHECK_DONE();
+}
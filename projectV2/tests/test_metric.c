@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "check.h"
+#include "../include/metric.h"
+#include "../include/config.h"
+
+/* Straightforward per-pixel reference for each metric */
+static double reference_pixel_error(ErrorMetric metric, int dr, int dg, int db, int da) {
+    double dy = 0.299 * dr + 0.587 * dg + 0.114 * db;
+    switch (metric) {
+        case METRIC_WEIGHTED:
+            return METRIC_WEIGHT_R * dr * dr + METRIC_WEIGHT_G * dg * dg +
+                   METRIC_WEIGHT_B * db * db + METRIC_WEIGHT_A * da * da;
+        case METRIC_LUMA:
+            return dy * dy;
+        case METRIC_MAX_ABS: {
+            int m = abs(dr);
+            if (abs(dg) > m) m = abs(dg);
+            if (abs(db) > m) m = abs(db);
+            if (abs(da) > m) m = abs(da);
+            return m;
+        }
+        case METRIC_YCBCR: {
+            double dcb = -0.168736 * dr - 0.331264 * dg + 0.5 * db;
+            double dcr = 0.5 * dr - 0.418688 * dg - 0.081312 * db;
+            return YCBCR_LUMA_WEIGHT * dy * dy + dcb * dcb + dcr * dcr + da * da;
+        }
+        default:
+            return dr * dr + dg * dg + db * db + da * da;
+    }
+}
+
+static double reference_block_error(ErrorMetric metric, const PixelBuffer *image, int x, int y, int size, Color avg) {
+    uint8_t ar, ag, ab, aa;
+    color_to_rgba(avg, &ar, &ag, &ab, &aa);
+    double error = 0.0;
+    for (int j = y; j < y + size; j++) {
+        for (int i = x; i < x + size; i++) {
+            const uint8_t *p = pixel_at(image, i, j);
+            error += reference_pixel_error(metric, p[0] - ar, p[1] - ag, p[2] - ab, p[3] - aa);
+        }
+    }
+    return error;
+}
+
+int main(void) {
+    QuadtreeContext buffers;
+    init_quadtree_context(&buffers);
+    PixelBuffer *rows = make_test_image(&buffers, 32, 1);
+    PixelBuffer *image = morton_pixel_buffer(&buffers, rows);
+
+    /* Block kernels agree with the per-pixel reference at every level */
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        for (int size = 32; size >= 1; size /= 2) {
+            for (int y = 0; y < 32; y += size) {
+                for (int x = 0; x < 32; x += size) {
+                    Color avg = average_color(image, x, y, size);
+                    double expected = reference_block_error(metric, rows, x, y, size, avg);
+                    double actual = metric_block_error(metric, image, x, y, size, avg);
+                    CHECK(fabs(actual - expected) <= 1e-9 * (1.0 + expected));
+                }
+            }
+        }
+    }
+
+    /* A flat block has no error whatever the metric */
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        Color avg = average_color(image, 0, 0, 16);
+        CHECK(metric_block_error(metric, image, 0, 0, 16, avg) == 0.0);
+        CHECK(metric_color_distance(metric, avg, avg) == 0.0);
+    }
+
+    /* The metric only comes from the context: two contexts, two results */
+    QuadtreeContext rgba, luma;
+    init_quadtree_context(&rgba);
+    init_quadtree_context(&luma);
+    luma.metric = METRIC_LUMA;
+    Color avg = average_color(image, 16, 16, 16);
+    CHECK(calculate_error(&rgba, image, 16, 16, 16, avg) ==
+          metric_block_error(METRIC_RGBA_SQUARED, image, 16, 16, 16, avg));
+    CHECK(calculate_error(&luma, image, 16, 16, 16, avg) ==
+          metric_block_error(METRIC_LUMA, image, 16, 16, 16, avg));
+
+    /* Names round-trip through the parser */
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        ErrorMetric parsed;
+        CHECK(parse_error_metric(error_metric_name(metric), &parsed) && parsed == (ErrorMetric)metric);
+    }
+    ErrorMetric unused;
+    CHECK(!parse_error_metric("nope", &unused));
+
+    free_pixel_buffer(&buffers, image);
+    free_pixel_buffer(&buffers, rows);
+    return CHECK_DONE();
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "check.h"
+#include "../include/metric.h"
+#include "../include/bottomup.h"
+#include "../include/ycbcr.h"
+#include "../include/parallel.h"
+
+/* Row-major reference: per-channel 64-bit sums over the block */
+static Color reference_average(const PixelBuffer *image, int x, int y, int size) {
+    uint64_t sum[4] = {0, 0, 0, 0};
+    for (int j = y; j < y + size; j++) {
+        for (int i = x; i < x + size; i++) {
+            const uint8_t *p = pixel_at(image, i, j);
+            for (int c = 0; c < 4; c++) sum[c] += p[c];
+        }
+    }
+    uint64_t count = (uint64_t)size * size;
+    return rgba_color((uint8_t)(sum[0] / count), (uint8_t)(sum[1] / count),
+                      (uint8_t)(sum[2] / count), (uint8_t)(sum[3] / count));
+}
+
+/* Row-major reference: the kernel applied one pixel at a time */
+static double reference_error(ErrorMetric metric, const PixelBuffer *image, int x, int y, int size, Color avg) {
+    PixelBuffer pixel = {NULL, 1, 1, PIXEL_LAYOUT_MORTON};
+    double error = 0.0;
+    for (int j = y; j < y + size; j++) {
+        for (int i = x; i < x + size; i++) {
+            pixel.pixels = (uint8_t*)pixel_at(image, i, j);
+            error += metric_block_error(metric, &pixel, 0, 0, 1, avg);
+        }
+    }
+    return error;
+}
+
+int main(void) {
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+
+    /* Every aligned block reads the same pixels in both layouts */
+    for (int size = 1; size <= 64; size *= 2) {
+        PixelBuffer *image = make_test_image(&ctx, size, (uint32_t)size);
+        PixelBuffer *morton = morton_pixel_buffer(&ctx, image);
+        CHECK(morton != NULL && morton->layout == PIXEL_LAYOUT_MORTON);
+        for (int j = 0; j < size; j++) {
+            for (int i = 0; i < size; i++) {
+                CHECK(memcmp(pixel_at(image, i, j), pixel_at(morton, i, j), 4) == 0);
+            }
+        }
+        for (int block = size; block >= 1; block /= 2) {
+            for (int y = 0; y < size; y += block) {
+                for (int x = 0; x < size; x += block) {
+                    Color avg = average_color(morton, x, y, block);
+                    CHECK(avg == reference_average(image, x, y, block));
+                    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+                        double expected = reference_error(metric, image, x, y, block, avg);
+                        double error = metric_block_error(metric, morton, x, y, block, avg);
+                        CHECK(fabs(error - expected) <= 1e-9 * (expected + 1.0));
+                    }
+                }
+            }
+        }
+
+        /* Row-major and Morton input encode to the same tree */
+        for (int metric = 0; metric < METRIC_COUNT; metric++) {
+            ctx.metric = metric;
+            QuadtreeNode *from_rows = encode_quadtree(&ctx, image);
+            QuadtreeNode *from_morton = encode_quadtree(&ctx, morton);
+            size_t rows_length, morton_length;
+            char *rows_data = save_to_memory(&ctx, from_rows, SAVE_FORMAT_QTC, 1, &rows_length);
+            char *morton_data = save_to_memory(&ctx, from_morton, SAVE_FORMAT_QTC, 1, &morton_length);
+            CHECK(rows_length == morton_length && memcmp(rows_data, morton_data, rows_length) == 0);
+            free(rows_data);
+            free(morton_data);
+            free_quadtree(&ctx, from_rows);
+            free_quadtree(&ctx, from_morton);
+        }
+        ctx.metric = METRIC_RGBA_SQUARED;
+        free_pixel_buffer(&ctx, morton);
+        free_pixel_buffer(&ctx, image);
+    }
+
+    /* Z-order has no room for other shapes: the conversion refuses them */
+    int shapes[][2] = {{100, 100}, {64, 32}, {3, 3}};
+    for (int s = 0; s < 3; s++) {
+        PixelBuffer *image = create_pixel_buffer(&ctx, shapes[s][0], shapes[s][1]);
+        memset(image->pixels, 0x7f, (size_t)shapes[s][0] * shapes[s][1] * 4);
+        PixelBuffer *owned = image;
+        CHECK(morton_pixel_buffer(&ctx, image) == NULL);
+        CHECK(ingest_pixel_buffer(&ctx, image, &owned) == NULL && owned == NULL);
+        CHECK(build_quadtree_bottom_up(&ctx, image) == NULL);
+        CHECK(build_ycbcr_quadtree(&ctx, image) == NULL);
+        CHECK(encode_quadtree(&ctx, image) == NULL);
+        free_pixel_buffer(&ctx, image);
+    }
+
+    /* A 4096x4096 white block sums past INT_MAX */
+    int large = 4096;
+    size_t pixels = (size_t)large * large;
+    PixelBuffer *white = create_pixel_buffer(&ctx, large, large);
+    memset(white->pixels, 255, pixels * 4);
+    white->layout = PIXEL_LAYOUT_MORTON;
+    CHECK(average_color(white, 0, 0, large) == rgba_color(255, 255, 255, 255));
+    free_pixel_buffer(&ctx, white);
+    uint8_t *plane = (uint8_t*)malloc(pixels);
+    memset(plane, 255, pixels);
+    QuadtreeNode *node = build_plane_quadtree(&ctx, plane, 0, 0, large, 0.0);
+    CHECK(node != NULL && node->children[0] == NULL);
+    CHECK(node != NULL && get_red_component(node->color) == 255 && node->error == 0.0);
+    free_quadtree(&ctx, node);
+    free(plane);
+
+    CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+    return CHECK_DONE();
+}
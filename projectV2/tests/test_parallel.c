@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "check.h"
+#include "../include/parallel.h"
+#include "../include/config.h"
+
+/* Allocator that notices nodes released away from the thread that owns
+ * the pass */
+typedef struct {
+    pthread_t owner;
+    int foreign_releases;
+} ThreadRecorder;
+
+static void* recording_alloc(void *user, size_t size) {
+    (void)user;
+    return malloc(size);
+}
+
+static void recording_release(void *user, void *ptr) {
+    ThreadRecorder *recorder = (ThreadRecorder*)user;
+    if (!pthread_equal(pthread_self(), recorder->owner)) {
+        __atomic_add_fetch(&recorder->foreign_releases, 1, __ATOMIC_RELAXED);
+    }
+    free(ptr);
+}
+
+static int same_ids(QuadtreeNode *a, QuadtreeNode *b) {
+    if (!a || !b) return a == b;
+    if (a->id != b->id) return 0;
+    for (int i = 0; i < 4; i++) {
+        if (!same_ids(a->children[i], b->children[i])) return 0;
+    }
+    return 1;
+}
+
+typedef struct {
+    QuadtreeContext *ctx;
+    QuadtreeNode *root;
+    const PixelBuffer *image;
+} MinimizeJob;
+
+static void* minimize_on_worker(void *arg) {
+    MinimizeJob *job = (MinimizeJob*)arg;
+    ThreadRecorder *recorder = (ThreadRecorder*)job->ctx->allocator.user;
+    recorder->owner = pthread_self();
+    minimize_with_loss_parallel(job->ctx, job->root, job->image);
+    return NULL;
+}
+
+int main(void) {
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+    PixelBuffer *image = make_test_image(&ctx, DEFAULT_IMAGE_SIZE, 21);
+    ctx.threads = 4;
+    QuadtreeNode *quadtree = encode_quadtree(&ctx, image);
+
+    /* Every format comes out byte for byte like the serial savers */
+    assign_ids_parallel(&ctx, quadtree);
+    SaveFormat formats[] = {SAVE_FORMAT_QTC, SAVE_FORMAT_QTN, SAVE_FORMAT_GRAPH};
+    for (int f = 0; f < 3; f++) {
+        size_t serial_length, parallel_length;
+        char *serial = save_to_memory(&ctx, quadtree, formats[f], 0, &serial_length);
+        char *parallel = save_to_memory(&ctx, quadtree, formats[f], 1, &parallel_length);
+        CHECK(serial_length == parallel_length && memcmp(serial, parallel, serial_length) == 0);
+        free(serial);
+        free(parallel);
+    }
+
+    /* Ids match the serial pre-order numbering */
+    QuadtreeNode *reference = encode_quadtree(&ctx, image);
+    int current_id = 0;
+    assign_ids(reference, &current_id);
+    CHECK(same_ids(quadtree, reference));
+
+    /* Parallel minimization merges the same nodes as the serial pass */
+    ctx.merge_threshold = 40.0;
+    minimize_with_loss_parallel(&ctx, quadtree, image);
+    minimize_with_loss(&ctx, reference, image);
+    size_t a_length, b_length;
+    char *a = save_to_memory(&ctx, quadtree, SAVE_FORMAT_QTC, 0, &a_length);
+    char *b = save_to_memory(&ctx, reference, SAVE_FORMAT_QTC, 0, &b_length);
+    CHECK(a_length == b_length && memcmp(a, b, a_length) == 0);
+    CHECK(ctx.stats.merges > 0);
+    free(a);
+    free(b);
+    free_quadtree(&ctx, quadtree);
+    free_quadtree(&ctx, reference);
+    CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+
+    /* A pass spreads over workers from whichever thread starts it, a context
+     * with threads = 1 keeps it on the caller */
+    ThreadRecorder recorder = {pthread_self(), 0};
+    QuadtreeContext recorded;
+    init_quadtree_context(&recorded);
+    recorded.threads = 4;
+    recorded.merge_threshold = 40.0;
+    recorded.allocator.alloc = recording_alloc;
+    recorded.allocator.release = recording_release;
+    recorded.allocator.user = &recorder;
+
+    quadtree = encode_quadtree(&recorded, image);
+    minimize_with_loss_parallel(&recorded, quadtree, image);
+    CHECK(recorder.foreign_releases > 0);
+    free_quadtree(&recorded, quadtree);
+
+    recorder.foreign_releases = 0;
+    quadtree = encode_quadtree(&recorded, image);
+    MinimizeJob job = {&recorded, quadtree, image};
+    pthread_t worker;
+    CHECK(pthread_create(&worker, NULL, minimize_on_worker, &job) == 0);
+    pthread_join(worker, NULL);
+    CHECK(recorder.foreign_releases > 0);
+    recorder.owner = pthread_self();
+    free_quadtree(&recorded, quadtree);
+
+    QuadtreeContext serial = recorded;
+    serial.threads = 1;
+    recorder.foreign_releases = 0;
+    quadtree = encode_quadtree(&serial, image);
+    job.ctx = &serial;
+    job.root = quadtree;
+    CHECK(pthread_create(&worker, NULL, minimize_on_worker, &job) == 0);
+    pthread_join(worker, NULL);
+    CHECK(recorder.foreign_releases == 0);
+    recorder.owner = pthread_self();
+    free_quadtree(&serial, quadtree);
+    CHECK(recorded.stats.nodes_created == recorded.stats.nodes_freed);
+    CHECK(serial.stats.nodes_created == serial.stats.nodes_freed);
+
+    free_pixel_buffer(&ctx, image);
+    return CHECK_DONE();
+}
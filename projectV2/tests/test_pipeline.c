@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "check.h"
+#include "../include/pipeline.h"
+#include "../include/image.h"
+#include "../include/config.h"
+
+#define ITEMS 1000
+
+typedef struct {
+    BoundedQueue *queue;
+    int first;
+    int pushed;
+} Producer;
+
+static void* produce(void *arg) {
+    Producer *producer = (Producer*)arg;
+    for (int i = 0; i < ITEMS; i++) {
+        if (!push_bounded_queue(producer->queue, (void*)(intptr_t)(producer->first + i + 1))) break;
+        producer->pushed++;
+    }
+    close_bounded_queue(producer->queue);
+    return NULL;
+}
+
+static int read_file(const char *path, char **data, long *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    *length = ftell(file);
+    rewind(file);
+    *data = (char*)malloc(*length);
+    int ok = fread(*data, 1, *length, file) == (size_t)*length;
+    fclose(file);
+    return ok;
+}
+
+int main(void) {
+    /* One producer, one consumer: items come out in push order */
+    BoundedQueue *queue = create_bounded_queue(4, 1);
+    Producer producer = {queue, 0, 0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, produce, &producer);
+    intptr_t expected = 1, item;
+    while ((item = (intptr_t)pop_bounded_queue(queue)) != 0) {
+        CHECK(item == expected);
+        expected++;
+    }
+    pthread_join(thread, NULL);
+    CHECK(expected == ITEMS + 1);
+    free_bounded_queue(queue);
+
+    /* Several producers: every item arrives once, then the queue reports
+     * the end only after the last producer closed it */
+    queue = create_bounded_queue(3, 3);
+    Producer producers[3] = {{queue, 0, 0}, {queue, ITEMS, 0}, {queue, 2 * ITEMS, 0}};
+    pthread_t threads[3];
+    for (int i = 0; i < 3; i++) pthread_create(&threads[i], NULL, produce, &producers[i]);
+    char *seen = (char*)calloc(3 * ITEMS + 1, 1);
+    int received = 0;
+    while ((item = (intptr_t)pop_bounded_queue(queue)) != 0) {
+        CHECK(item >= 1 && item <= 3 * ITEMS && !seen[item]);
+        seen[item] = 1;
+        received++;
+    }
+    for (int i = 0; i < 3; i++) pthread_join(threads[i], NULL);
+    CHECK(received == 3 * ITEMS);
+    free(seen);
+    free_bounded_queue(queue);
+
+    /* Aborting releases a producer blocked on a full queue */
+    queue = create_bounded_queue(1, 1);
+    producer = (Producer){queue, 0, 0};
+    pthread_create(&thread, NULL, produce, &producer);
+    int queued = 0;
+    while (!queued) {
+        usleep(1000);
+        pthread_mutex_lock(&queue->lock);
+        queued = queue->count;
+        pthread_mutex_unlock(&queue->lock);
+    }
+    usleep(10000);
+    abort_bounded_queue(queue);
+    pthread_join(thread, NULL);
+    CHECK(producer.pushed == 1);
+    CHECK(pop_bounded_queue(queue) == NULL);
+    CHECK(drain_bounded_queue(queue) == (void*)1);
+    CHECK(drain_bounded_queue(queue) == NULL);
+    free_bounded_queue(queue);
+
+    /* End to end: every image is encoded exactly as a serial encode */
+    char input_dir[] = "/tmp/qt_pipeline_inXXXXXX";
+    char output_dir[] = "/tmp/qt_pipeline_outXXXXXX";
+    CHECK(mkdtemp(input_dir) && mkdtemp(output_dir));
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+    for (int i = 0; i < 5; i++) {
+        char path[MAX_FILENAME_LENGTH];
+        snprintf(path, sizeof(path), "%s/image%d.ppm", input_dir, i);
+        PixelBuffer *image = make_test_image(&ctx, DEFAULT_IMAGE_SIZE, i);
+        write_ppm(path, image);
+        free_pixel_buffer(&ctx, image);
+    }
+
+    /* An output that can't be written is a failure, not a success */
+    char blocked_input[MAX_FILENAME_LENGTH], blocked_output[MAX_FILENAME_LENGTH];
+    snprintf(blocked_input, sizeof(blocked_input), "%s/blocked.ppm", input_dir);
+    snprintf(blocked_output, sizeof(blocked_output), "%s/blocked.qtc", output_dir);
+    PixelBuffer *blocked = make_test_image(&ctx, DEFAULT_IMAGE_SIZE, 9);
+    write_ppm(blocked_input, blocked);
+    free_pixel_buffer(&ctx, blocked);
+    mkdir(blocked_output, 0700);
+
+    PipelineConfig config = default_pipeline_config();
+    int failures = -1;
+    CHECK(run_encode_pipeline(&ctx, input_dir, output_dir, &config, &failures) == 5);
+    CHECK(failures == 1);
+    rmdir(blocked_output);
+    remove(blocked_input);
+    for (int i = 0; i < 5; i++) {
+        char input[MAX_FILENAME_LENGTH], output[MAX_FILENAME_LENGTH], reference[MAX_FILENAME_LENGTH];
+        snprintf(input, sizeof(input), "%s/image%d.ppm", input_dir, i);
+        snprintf(output, sizeof(output), "%s/image%d.qtc", output_dir, i);
+        snprintf(reference, sizeof(reference), "%s/reference%d.qtc", output_dir, i);
+
+        PixelBuffer *image = load_source_image(&ctx, input);
+        QuadtreeNode *quadtree = encode_quadtree(&ctx, image);
+        save_image_quadtree(&ctx, reference, quadtree);
+        free_quadtree(&ctx, quadtree);
+        free_pixel_buffer(&ctx, image);
+
+        char *a = NULL, *b = NULL;
+        long a_length = 0, b_length = -1;
+        CHECK(read_file(output, &a, &a_length) && read_file(reference, &b, &b_length));
+        CHECK(a_length == b_length && memcmp(a, b, a_length) == 0);
+        free(a);
+        free(b);
+        remove(output);
+        remove(reference);
+        remove(input);
+    }
+    CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+
+    /* A stage without workers is refused instead of deadlocking */
+    config.build_workers = 0;
+    CHECK(run_encode_pipeline(&ctx, input_dir, output_dir, &config, &failures) == -1);
+    config = default_pipeline_config();
+    CHECK(run_encode_pipeline(&ctx, "/nonexistent/qt", output_dir, &config, &failures) == -1);
+
+    rmdir(input_dir);
+    rmdir(output_dir);
+    return CHECK_DONE();
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "../include/raster.h"
+#include "../include/config.h"
+
+/* Reads a P6 file written by the decoder, RGB only */
+static unsigned char* read_ppm(const char *path, int *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    int width, height, max;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &max) != 3 || width != height) {
+        fclose(file);
+        return NULL;
+    }
+    fgetc(file);
+    unsigned char *rgb = (unsigned char*)malloc((size_t)width * height * 3);
+    size_t read = fread(rgb, 1, (size_t)width * height * 3, file);
+    fclose(file);
+    if (read != (size_t)width * height * 3) {
+        free(rgb);
+        return NULL;
+    }
+    *size = width;
+    return rgb;
+}
+
+static void copy_prefix(const char *source, const char *destination, long length) {
+    FILE *in = fopen(source, "rb");
+    FILE *out = fopen(destination, "wb");
+    char *buffer = (char*)malloc(length);
+    fwrite(buffer, 1, fread(buffer, 1, length, in), out);
+    free(buffer);
+    fclose(in);
+    fclose(out);
+}
+
+int main(void) {
+    char dir[] = "/tmp/qt_rasterXXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    char qtc[MAX_FILENAME_LENGTH], qtn[MAX_FILENAME_LENGTH], ppm[MAX_FILENAME_LENGTH], cut[MAX_FILENAME_LENGTH];
+    snprintf(qtc, sizeof(qtc), "%s/tree.qtc", dir);
+    snprintf(qtn, sizeof(qtn), "%s/tree.qtn", dir);
+    snprintf(ppm, sizeof(ppm), "%s/out.ppm", dir);
+    snprintf(cut, sizeof(cut), "%s/cut.qtc", dir);
+
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+    PixelBuffer *image = make_test_image(&ctx, DEFAULT_IMAGE_SIZE, 3);
+    QuadtreeNode *quadtree = encode_quadtree(&ctx, image);
+    save_image_quadtree(&ctx, qtc, quadtree);
+    save_image_quadtree_bw(&ctx, qtn, quadtree);
+    free_quadtree(&ctx, quadtree);
+
+    /* The lossless tree decodes back to the source pixels */
+    int size = 0;
+    CHECK(decode_quadtree_to_ppm(&ctx, qtc, ppm, DEFAULT_IMAGE_SIZE));
+    unsigned char *rgb = read_ppm(ppm, &size);
+    CHECK(rgb && size == DEFAULT_IMAGE_SIZE);
+    int same = 1;
+    for (int j = 0; rgb && j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            if (memcmp(rgb + ((size_t)j * size + i) * 3, pixel_at(image, i, j), 3) != 0) same = 0;
+        }
+    }
+    CHECK(same);
+    free(rgb);
+
+    /* A thumbnail pixel is the mean of the block it covers: the top-left
+     * quarter of the test image is flat */
+    CHECK(decode_quadtree_to_ppm(&ctx, qtc, ppm, 4));
+    rgb = read_ppm(ppm, &size);
+    CHECK(rgb && size == 4);
+    if (rgb) {
+        CHECK(rgb[0] == 200 && rgb[1] == 40 && rgb[2] == 90);
+        CHECK(rgb[3] == 200 && rgb[4] == 40 && rgb[5] == 90);
+    }
+    free(rgb);
+
+    /* QTN decodes to gray */
+    CHECK(decode_quadtree_to_ppm(&ctx, qtn, ppm, 64));
+    rgb = read_ppm(ppm, &size);
+    CHECK(rgb && size == 64);
+    for (int k = 0; rgb && k < size * size; k++) {
+        if (rgb[3 * k] != rgb[3 * k + 1] || rgb[3 * k] != rgb[3 * k + 2]) same = 0;
+    }
+    CHECK(same);
+    free(rgb);
+
+    /* Truncated input fails and leaves no output behind */
+    FILE *file = fopen(qtc, "rb");
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fclose(file);
+    long cuts[] = {0, 3, length / 2, length - 1};
+    for (int i = 0; i < 4; i++) {
+        copy_prefix(qtc, cut, cuts[i]);
+        remove(ppm);
+        CHECK(!decode_quadtree_to_ppm(&ctx, cut, ppm, DEFAULT_IMAGE_SIZE));
+        CHECK(access(ppm, F_OK) != 0);
+    }
+
+    /* A stream of internal nodes only is refused at every output size
+     * instead of recursing until the stack runs out */
+    FILE *zeros = fopen(cut, "wb");
+    char *block = (char*)calloc(1, 1 << 20);
+    for (int i = 0; i < 8; i++) fwrite(block, 1, 1 << 20, zeros);
+    free(block);
+    fclose(zeros);
+    int output_sizes[] = {1, 64, DEFAULT_IMAGE_SIZE, 2 * DEFAULT_IMAGE_SIZE};
+    for (int i = 0; i < 4; i++) {
+        remove(ppm);
+        CHECK(!decode_quadtree_to_ppm(&ctx, cut, ppm, output_sizes[i]));
+        CHECK(access(ppm, F_OK) != 0);
+    }
+
+    /* Bad sizes and missing inputs are refused */
+    CHECK(!decode_quadtree_to_ppm(&ctx, qtc, ppm, 100));
+    CHECK(!decode_quadtree_to_ppm(&ctx, "/nonexistent.qtc", ppm, 64));
+
+    free_pixel_buffer(&ctx, image);
+    remove(qtc);
+    remove(qtn);
+    remove(cut);
+    remove(ppm);
+    rmdir(dir);
+    return CHECK_DONE();
+}
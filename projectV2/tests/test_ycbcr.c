@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "../include/ycbcr.h"
+#include "../include/raster.h"
+#include "../include/config.h"
+
+static int count_nodes(QuadtreeNode *node) {
+    if (!node) return 0;
+    int count = 1;
+    for (int i = 0; i < 4; i++) count += count_nodes(node->children[i]);
+    return count;
+}
+
+/* Writes a .qty header followed by single-leaf planes */
+static void write_qty(const char *path, int luma_size, int chroma_size) {
+    FILE *file = fopen(path, "wb");
+    fwrite("QTY1", 1, 4, file);
+    fwrite(&luma_size, sizeof(int), 1, file);
+    fwrite(&chroma_size, sizeof(int), 1, file);
+    for (int plane = 0; plane < 3; plane++) {
+        int is_leaf = 1;
+        uint8_t gray = 128;
+        fwrite(&is_leaf, sizeof(int), 1, file);
+        fwrite(&gray, sizeof(uint8_t), 1, file);
+    }
+    fclose(file);
+}
+
+int main(void) {
+    char dir[] = "/tmp/qt_ycbcrXXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    char qty[MAX_FILENAME_LENGTH], ppm[MAX_FILENAME_LENGTH];
+    snprintf(qty, sizeof(qty), "%s/tree.qty", dir);
+    snprintf(ppm, sizeof(ppm), "%s/out.ppm", dir);
+
+    QuadtreeContext ctx;
+    init_quadtree_context(&ctx);
+    PixelBuffer *image = make_test_image(&ctx, 64, 5);
+
+    /* Saved trees load back with the same shape and rasterize identically */
+    YCbCrQuadtree *built = build_ycbcr_quadtree(&ctx, image);
+    CHECK(built && built->luma_size == 64 && built->chroma_size == 64 / CHROMA_SUBSAMPLING);
+    save_image_quadtree_ycbcr(qty, built);
+    YCbCrQuadtree *loaded = load_image_quadtree_ycbcr(&ctx, qty);
+    CHECK(loaded != NULL);
+    if (built && loaded) {
+        CHECK(count_nodes(built->luma) == count_nodes(loaded->luma));
+        CHECK(count_nodes(built->cb) == count_nodes(loaded->cb));
+        CHECK(count_nodes(built->cr) == count_nodes(loaded->cr));
+        uint8_t *expected = (uint8_t*)malloc(64 * 64 * 3);
+        uint8_t *actual = (uint8_t*)malloc(64 * 64 * 3);
+        CHECK(rasterize_ycbcr_quadtree(&ctx, built, expected));
+        CHECK(rasterize_ycbcr_quadtree(&ctx, loaded, actual));
+        CHECK(memcmp(expected, actual, 64 * 64 * 3) == 0);
+        free(expected);
+        free(actual);
+    }
+    if (built) free_ycbcr_quadtree(&ctx, built);
+    if (loaded) free_ycbcr_quadtree(&ctx, loaded);
+    CHECK(decode_quadtree_to_ppm(&ctx, qty, ppm, 64));
+
+    /* A well-formed header with one-leaf planes is accepted */
+    write_qty(qty, 8, 4);
+    loaded = load_image_quadtree_ycbcr(&ctx, qty);
+    CHECK(loaded != NULL);
+    if (loaded) free_ycbcr_quadtree(&ctx, loaded);
+
+    /* Headers whose chroma plane does not tile the luma plane are refused
+     * before anything is rasterized, and the decoder leaves no output */
+    int bad[][2] = {{8, 3}, {12, 4}, {8, 0}, {0, 0}, {4, 8}, {-8, 4}, {1 << 20, 4}};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        write_qty(qty, bad[i][0], bad[i][1]);
+        CHECK(load_image_quadtree_ycbcr(&ctx, qty) == NULL);
+        remove(ppm);
+        CHECK(!decode_quadtree_to_ppm(&ctx, qty, ppm, 8));
+        CHECK(access(ppm, F_OK) != 0);
+    }
+
+    CHECK(ctx.stats.nodes_created == ctx.stats.nodes_freed);
+
+    free_pixel_buffer(&ctx, image);
+    remove(qty);
+    remove(ppm);
+    rmdir(dir);
+    return CHECK_DONE();
+}